@@ -0,0 +1,814 @@
+#ifndef ADDRESS_COUNT_HANDLER_HPP
+#define ADDRESS_COUNT_HANDLER_HPP
+
+/*
+  Handler that counts the addresses (house numbers) in the input,
+  shared by count_addresses and osmcombined.
+*/
+
+/*
+
+Written 2012 by Frederik Ramm <frederik@remote.org>
+Ported 2016 to libosmium 2.9 by Philip Beelmann <beelmann@geofabik.de>
+
+Public Domain.
+
+*/
+
+#include <iostream>
+
+#include <osmium/osm.hpp>
+#include <osmium/handler.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "address_export.hpp"
+#include "external_sort.hpp"
+#include "hash.hpp"
+#include "hyperloglog.hpp"
+#include "string_set.hpp"
+
+/*
+  House numbers are only ever looked up for the nodes of interpolation
+  ways. Their ids are collected in a first pass into a sorted vector;
+  the node pass then records house numbers for these ids only, in flat
+  arrays parallel to the ids. Distinct ids occupy distinct array
+  elements, so worker threads can call set() concurrently.
+*/
+class HousenumberStore
+{
+
+private:
+    std::vector<osmium::unsigned_object_id_type> ids;
+    std::vector<uint16_t> numbers;
+    std::vector<uint8_t> addressed;
+
+    // --export: street, city and post code of every node as ids into
+    // 'strings' (StringSet::npos if missing), three per node
+    bool keep_strings = false;
+    std::vector<uint32_t> string_ids;
+    StringSet strings;
+    std::mutex strings_mutex;
+
+    size_t find(osmium::unsigned_object_id_type id) const
+    {
+        auto it = std::lower_bound(ids.begin(), ids.end(), id);
+        if (it == ids.end() || *it != id) return ids.size();
+        return it - ids.begin();
+    }
+
+public:
+
+    void add_id(osmium::unsigned_object_id_type id)
+    {
+        ids.push_back(id);
+    }
+
+    // must be called after the last add_id() and before set()/get()
+    void prepare()
+    {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        ids.shrink_to_fit();
+        numbers.assign(ids.size(), 0);
+        addressed.assign(ids.size(), 0);
+        if (keep_strings) string_ids.assign(ids.size() * 3, StringSet::npos);
+    }
+
+    // must be called before prepare()
+    void enable_strings()
+    {
+        keep_strings = true;
+    }
+
+    void set(osmium::unsigned_object_id_type id, uint16_t number)
+    {
+        size_t i = find(id);
+        if (i == ids.size()) return;
+        numbers[i] = number;
+        addressed[i] = 1;
+    }
+
+    void set_strings(osmium::unsigned_object_id_type id, const char *street, const char *city, const char *postcode)
+    {
+        size_t i = find(id);
+        if (i == ids.size()) return;
+        std::lock_guard<std::mutex> lock(strings_mutex);
+        if (street) string_ids[i * 3] = strings.insert(street);
+        if (city) string_ids[i * 3 + 1] = strings.insert(city);
+        if (postcode) string_ids[i * 3 + 2] = strings.insert(postcode);
+    }
+
+    // field 0 is the street, 1 the city and 2 the post code; only valid
+    // once all nodes have been read
+    const char *get_string(osmium::unsigned_object_id_type id, int field) const
+    {
+        size_t i = find(id);
+        if (i == ids.size() || !keep_strings || string_ids[i * 3 + field] == StringSet::npos) return nullptr;
+        return strings.get(string_ids[i * 3 + field]);
+    }
+
+    // true if the node has an addr:housenumber tag, even if it is not
+    // numeric
+    bool has_address(osmium::unsigned_object_id_type id) const
+    {
+        size_t i = find(id);
+        return i != ids.size() && addressed[i];
+    }
+
+    // returns 0 for nodes without house number
+    uint16_t get(osmium::unsigned_object_id_type id) const
+    {
+        size_t i = find(id);
+        return (i == ids.size()) ? 0 : numbers[i];
+    }
+
+    // saves or restores the prepared store, without the strings
+    // (see checkpoint.hpp)
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        archive.field(ids);
+        archive.field(numbers);
+        archive.field(addressed);
+    }
+
+};
+
+/* ================================================== */
+
+/*
+  Locations of the nodes needed by --export (the nodes of address ways
+  and of interpolation ways), stored like the house numbers above.
+*/
+class LocationStore
+{
+
+private:
+    std::vector<osmium::unsigned_object_id_type> ids;
+    std::vector<osmium::Location> locations;
+
+    // The ids of the nodes in a buffer are ascending, so the search
+    // starts with an exponential search from the previous position.
+    size_t find(osmium::unsigned_object_id_type id, size_t& hint) const
+    {
+        if (hint >= ids.size() || ids[hint] > id) hint = 0;
+        size_t lo = hint;
+        size_t hi = hint;
+        size_t step = 1;
+        while (hi < ids.size() && ids[hi] < id)
+        {
+            lo = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        size_t end = std::min(hi + 1, ids.size());
+        size_t i = std::lower_bound(ids.begin() + lo, ids.begin() + end, id) - ids.begin();
+        hint = i;
+        return (i < ids.size() && ids[i] == id) ? i : ids.size();
+    }
+
+public:
+
+    void add_id(osmium::unsigned_object_id_type id)
+    {
+        ids.push_back(id);
+    }
+
+    // must be called after the last add_id() and before set()/get()
+    void prepare()
+    {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        ids.shrink_to_fit();
+        locations.assign(ids.size(), osmium::Location());
+    }
+
+    void set(osmium::unsigned_object_id_type id, const osmium::Location& location, size_t& hint)
+    {
+        size_t i = find(id, hint);
+        if (i != ids.size()) locations[i] = location;
+    }
+
+    // returns an invalid location for unknown nodes
+    osmium::Location get(osmium::unsigned_object_id_type id) const
+    {
+        size_t hint = 0;
+        size_t i = find(id, hint);
+        return (i == ids.size()) ? osmium::Location() : locations[i];
+    }
+
+};
+
+/* ================================================== */
+
+class InterpolationNodeHandler : public osmium::handler::Handler
+{
+
+private:
+    HousenumberStore& housenumbers;
+    LocationStore *locations;
+
+public:
+
+    // locations may be null if no node locations are needed
+    InterpolationNodeHandler(HousenumberStore& housenumbers, LocationStore *locations) : housenumbers(housenumbers), locations(locations) {
+    }
+
+    void way(const osmium::Way& way)
+    {
+        if (way.tags().get_value_by_key("addr:interpolation"))
+        {
+            for (const osmium::NodeRef& nr : way.nodes()) housenumbers.add_id(nr.ref());
+            if (locations && !way.nodes().empty())
+            {
+                locations->add_id(way.nodes().front().ref());
+                locations->add_id(way.nodes().back().ref());
+            }
+        }
+        else if (locations && way.tags().get_value_by_key("addr:housenumber"))
+        {
+            for (const osmium::NodeRef& nr : way.nodes()) locations->add_id(nr.ref());
+        }
+    }
+
+};
+
+/* ================================================== */
+
+/*
+  Record written for --duplicates: a 128 bit hash of the normalized
+  address (street, house number, post code, city) and the object.
+*/
+struct AddressRecord
+{
+    uint64_t hash_high;
+    uint64_t hash_low;
+    // object id, with the top bit set for ways
+    uint64_t object;
+
+    bool operator<(const AddressRecord& other) const
+    {
+        if (hash_high != other.hash_high) return hash_high < other.hash_high;
+        if (hash_low != other.hash_low) return hash_low < other.hash_low;
+        return object < other.object;
+    }
+
+    bool same_address(const AddressRecord& other) const
+    {
+        return hash_high == other.hash_high && hash_low == other.hash_low;
+    }
+};
+
+const uint64_t address_record_way_bit = uint64_t(1) << 63;
+
+/* ================================================== */
+
+class AddressCountHandler : public osmium::handler::Handler
+{
+
+private:
+    HousenumberStore& housenumbers;
+    size_t numbers_nodes_overall = 0;
+    size_t numbers_nodes_withstreet = 0;
+    size_t numbers_nodes_withcity = 0;
+    size_t numbers_nodes_withcountry = 0;
+    size_t numbers_nodes_withpostcode = 0;
+    size_t numbers_ways_overall = 0;
+    size_t numbers_ways_withstreet = 0;
+    size_t numbers_ways_withcity = 0;
+    size_t numbers_ways_withcountry = 0;
+    size_t numbers_ways_withpostcode = 0;
+    size_t postcode_boundaries = 0;
+    size_t interpolation_count = 0;
+    size_t interpolation_error = 0;
+    size_t numbers_through_interpolation = 0;
+    StringSet postcodes;
+    bool debug;
+
+    struct Interpolation
+    {
+        osmium::object_id_type way_id;
+        osmium::unsigned_object_id_type fromnode;
+        osmium::unsigned_object_id_type tonode;
+        uint32_t mode;
+        // intermediate nodes are interior_nodes[interior_begin..interior_end)
+        size_t interior_begin;
+        size_t interior_end;
+        // --export: addr:street, addr:city and addr:postcode of the way
+        // as ids into 'interpolation_tags'
+        uint32_t street;
+        uint32_t city;
+        uint32_t postcode;
+    };
+    std::vector<Interpolation> pending_interpolations;
+    std::vector<osmium::unsigned_object_id_type> interior_nodes;
+    StringSet interpolation_modes;
+    StringSet interpolation_tags;
+
+    // --approx: distinct post codes are estimated with a sketch per
+    // addr:country value (indexed by the id of the country in
+    // 'countries') instead of being stored
+    bool approx;
+    StringSet countries;
+    std::vector<HyperLogLog> country_postcodes;
+
+    // --duplicates: hashes of all addresses, sorted externally
+    std::unique_ptr<ExternalSorter<AddressRecord>> duplicates;
+    std::string normalized;
+
+    // --export: rows are collected here and handed to the exporter
+    AddressExport *exporter = nullptr;
+    LocationStore *locations = nullptr;
+    AddressRowGroup export_rows;
+    size_t location_hint = 0;
+
+    void export_row(osmium::object_id_type id, char type, const osmium::Location& location, const osmium::TagList& tags, const char *hno)
+    {
+        export_rows.add(id, type, location, tags.get_value_by_key("addr:street"), tags.get_value_by_key("addr:city"), tags.get_value_by_key("addr:postcode"), hno);
+        if (export_rows.full()) exporter->write(export_rows);
+    }
+
+    // average location of the nodes of the way
+    osmium::Location centroid(const osmium::Way& way) const
+    {
+        const osmium::WayNodeList& nodes = way.nodes();
+        size_t n = nodes.size();
+        // don't count the first node of closed ways twice
+        if (n > 1 && nodes.front().ref() == nodes.back().ref()) n--;
+        int64_t x = 0;
+        int64_t y = 0;
+        int64_t count = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            osmium::Location l = locations->get(nodes[i].ref());
+            if (!l.valid()) continue;
+            x += l.x();
+            y += l.y();
+            count++;
+        }
+        if (!count) return osmium::Location();
+        return osmium::Location(int32_t(x / count), int32_t(y / count));
+    }
+
+    // one row for each house number added by the interpolation, placed
+    // on the straight line between the end nodes
+    void export_interpolation(const Interpolation& ip, osmium::unsigned_object_id_type lownode, osmium::unsigned_object_id_type highnode, uint16_t fromhouse, uint16_t tohouse, int step)
+    {
+        osmium::Location a = locations->get(lownode);
+        osmium::Location b = locations->get(highnode);
+        bool located = a.valid() && b.valid();
+        const char *tags[3];
+        const uint32_t ids[3] = { ip.street, ip.city, ip.postcode };
+        for (int f = 0; f < 3; f++)
+        {
+            tags[f] = (ids[f] != StringSet::npos) ? interpolation_tags.get(ids[f]) : housenumbers.get_string(lownode, f);
+        }
+        for (int h = fromhouse + step; h < tohouse; h += step)
+        {
+            bool taken = false;
+            for (size_t i = ip.interior_begin; i < ip.interior_end; i++)
+            {
+                if (housenumbers.has_address(interior_nodes[i]) && housenumbers.get(interior_nodes[i]) == h) taken = true;
+            }
+            if (taken) continue;
+            osmium::Location l;
+            if (located)
+            {
+                int64_t dx = int64_t(b.x()) - a.x();
+                int64_t dy = int64_t(b.y()) - a.y();
+                l = osmium::Location(int32_t(a.x() + dx * (h - fromhouse) / (tohouse - fromhouse)), int32_t(a.y() + dy * (h - fromhouse) / (tohouse - fromhouse)));
+            }
+            export_rows.add(ip.way_id, 'i', l, tags[0], tags[1], tags[2], std::to_string(h).c_str());
+            if (export_rows.full()) exporter->write(export_rows);
+        }
+    }
+
+    // appends the value lower-cased and with runs of white space
+    // collapsed into single blanks, followed by a separator
+    void append_normalized(const char *value)
+    {
+        bool blank = false;
+        for (const char *c = value; c && *c; c++)
+        {
+            if (isspace((unsigned char) *c))
+            {
+                blank = true;
+                continue;
+            }
+            if (blank && !normalized.empty() && normalized.back() != '\x1f') normalized += ' ';
+            blank = false;
+            normalized += tolower((unsigned char) *c);
+        }
+        normalized += '\x1f';
+    }
+
+    void add_duplicate_candidate(const osmium::OSMObject& object, const char *hno)
+    {
+        const char *street = object.tags().get_value_by_key("addr:street");
+        if (!street) street = object.tags().get_value_by_key("addr:place");
+        if (!street) return;
+        normalized.clear();
+        append_normalized(street);
+        append_normalized(hno);
+        append_normalized(object.tags().get_value_by_key("addr:postcode"));
+        append_normalized(object.tags().get_value_by_key("addr:city"));
+        AddressRecord r;
+        r.hash_high = hash_bytes(normalized.data(), normalized.size(), 0x9e3779b97f4a7c15ULL);
+        r.hash_low = hash_bytes(normalized.data(), normalized.size(), 0xc2b2ae3d27d4eb4fULL);
+        r.object = static_cast<uint64_t>(object.id()) & ~address_record_way_bit;
+        if (object.type() == osmium::item_type::way) r.object |= address_record_way_bit;
+        duplicates->add(r);
+    }
+
+    static void print_object(uint64_t object)
+    {
+        std::cout << ((object & address_record_way_bit) ? 'w' : 'n') << (object & ~address_record_way_bit);
+    }
+
+    void add_postcode(const char *code, const char *country)
+    {
+        if (!approx)
+        {
+            postcodes.insert(code);
+            return;
+        }
+        uint32_t c = countries.insert(country ? country : "");
+        if (c == country_postcodes.size()) country_postcodes.emplace_back(12);
+        country_postcodes[c].add(hash_string(code));
+    }
+
+    // Interpolation ways are only evaluated after all nodes have been
+    // seen, so that the result does not depend on the order in which
+    // (possibly parallel) workers process the input.
+    void interpolate(const Interpolation& ip)
+    {
+        osmium::unsigned_object_id_type fromnode = ip.fromnode;
+        osmium::unsigned_object_id_type tonode = ip.tonode;
+        const char* inter = interpolation_modes.get(ip.mode);
+        uint16_t fromhouse = housenumbers.get(fromnode);
+        uint16_t tohouse = housenumbers.get(tonode);
+
+        // back out if we don't have both house numbers
+        if (!(fromhouse && tohouse)) 
+        {
+            interpolation_error++;
+            if (debug)
+            {
+
+                if (!fromhouse) std::cerr << "interpolation way " << ip.way_id << " references node " << fromnode << " which has no addr:housenumber" << std::endl;
+                if (!tohouse) std::cerr << "interpolation way " << ip.way_id << " references node " << tonode << " which has no addr:housenumber" << std::endl;
+            }
+            return;
+        }
+
+        osmium::unsigned_object_id_type lownode = fromnode;
+        osmium::unsigned_object_id_type highnode = tonode;
+
+        // swap if range is backwards
+        if (tohouse < fromhouse) 
+        {
+            fromhouse = tohouse;
+            tohouse = housenumbers.get(fromnode);
+            lownode = tonode;
+            highnode = fromnode;
+        }
+
+        long added;
+        if (!strcmp(inter, "even"))
+        {
+            if ((fromhouse %2 == 1) || (tohouse %2 == 1))
+            {
+                if (debug)
+                {
+                    if (fromhouse%2==1) std::cerr << "interpolation way " << ip.way_id << " (addr:interpolation=even) references node " << fromnode << " which has an odd house number of " << fromhouse << std::endl;
+                    if (tohouse%2==1) std::cerr << "interpolation way " << ip.way_id << " (addr:interpolation=even) references node " << tonode << " which has an odd house number of " << tohouse << std::endl;
+                }
+                interpolation_error++;
+                return;
+            }
+            added = (tohouse - fromhouse) / 2 - 1;
+        }
+        else if (!strcmp(inter, "odd"))
+        {
+            if ((fromhouse %2 == 0) || (tohouse %2 == 0))
+            {
+                if (debug)
+                {
+                    if (fromhouse%2==1) std::cerr << "interpolation way " << ip.way_id << " (addr:interpolation=odd) references node " << fromnode << " which has an even house number of " << fromhouse << std::endl;
+                    if (tohouse%2==1) std::cerr << "interpolation way " << ip.way_id << " (addr:interpolation=odd) references node " << tonode << " which has an even house number of " << tohouse << std::endl;
+                }
+                interpolation_error++;
+                return;
+            }
+            added = (tohouse - fromhouse) / 2 - 1;
+        }
+        else if (!strcmp(inter, "both") || !strcmp(inter, "all"))
+        {
+            added = (tohouse - fromhouse) - 1;
+        }
+        else
+        {
+            if (debug)
+            {
+                std::cerr << "interpolation way " << ip.way_id << " has invalid interpolation mode '" << inter << "'" << std::endl;
+            }
+            interpolation_error++;
+            return;
+        }
+
+        // intermediate nodes with addresses are already counted as
+        // address nodes
+        long counted = 0;
+        for (size_t i = ip.interior_begin; i < ip.interior_end; i++)
+        {
+            if (housenumbers.has_address(interior_nodes[i])) counted++;
+        }
+        if (added < 0) counted = 0;
+        else if (counted > added) counted = added;
+        numbers_through_interpolation += added - counted;
+
+        if (exporter) export_interpolation(ip, lownode, highnode, fromhouse, tohouse, strcmp(inter, "even") && strcmp(inter, "odd") ? 1 : 2);
+    }
+
+
+public:
+
+    AddressCountHandler(bool debug, bool approx, HousenumberStore& housenumbers) : housenumbers(housenumbers), debug(debug), approx(approx){
+    }
+
+    void node(const osmium::Node& node)
+    {
+        const char *hno = node.tags().get_value_by_key("addr:housenumber");
+        if (hno)
+        {
+            housenumbers.set(node.id(), atoi(hno));
+            numbers_nodes_overall ++;
+            if (node.tags().get_value_by_key("addr:street")) numbers_nodes_withstreet ++;
+            if (node.tags().get_value_by_key("addr:city")) numbers_nodes_withcity ++;
+            const char *country = node.tags().get_value_by_key("addr:country");
+            if (country) numbers_nodes_withcountry ++;
+            const char *pc = node.tags().get_value_by_key("addr:postcode");
+            if (pc)
+            {
+                numbers_nodes_withpostcode ++;
+                add_postcode(pc, country);
+            }
+            if (duplicates) add_duplicate_candidate(node, hno);
+            if (exporter)
+            {
+                export_row(node.id(), 'n', node.location(), node.tags(), hno);
+                housenumbers.set_strings(node.id(), node.tags().get_value_by_key("addr:street"), node.tags().get_value_by_key("addr:city"), pc);
+            }
+        }
+        if (locations) locations->set(node.id(), node.location(), location_hint);
+    }
+
+    void way(const osmium::Way& way)
+    {
+        const char* inter = way.tags().get_value_by_key("addr:interpolation");
+        if (inter)
+        {
+            interpolation_count ++;
+            if (way.nodes().empty())
+            {
+                interpolation_error++;
+                return;
+            }
+            osmium::unsigned_object_id_type fromnode = way.nodes().front().ref();
+            osmium::unsigned_object_id_type tonode = way.nodes().back().ref();
+            size_t interior_begin = interior_nodes.size();
+            for (size_t i = 1; i + 1 < way.nodes().size(); i++)
+            {
+                osmium::unsigned_object_id_type id = way.nodes()[i].ref();
+                if (id != fromnode && id != tonode) interior_nodes.push_back(id);
+            }
+            uint32_t tags[3] = { StringSet::npos, StringSet::npos, StringSet::npos };
+            if (exporter)
+            {
+                const char *keys[3] = { "addr:street", "addr:city", "addr:postcode" };
+                for (int f = 0; f < 3; f++)
+                {
+                    const char *value = way.tags().get_value_by_key(keys[f]);
+                    if (value) tags[f] = interpolation_tags.insert(value);
+                }
+            }
+            pending_interpolations.push_back(Interpolation{way.id(), fromnode, tonode, interpolation_modes.insert(inter), interior_begin, interior_nodes.size(), tags[0], tags[1], tags[2]});
+        }
+        else
+        {
+            const char *hno = way.tags().get_value_by_key("addr:housenumber");
+            if (hno)
+            {
+                numbers_ways_overall ++;
+                if (way.tags().get_value_by_key("addr:street")) numbers_ways_withstreet ++;
+                if (way.tags().get_value_by_key("addr:city")) numbers_ways_withcity ++;
+                const char *country = way.tags().get_value_by_key("addr:country");
+                if (country) numbers_ways_withcountry ++;
+                const char *pc = way.tags().get_value_by_key("addr:postcode");
+                if (pc)
+                {
+                    numbers_ways_withpostcode ++;
+                    add_postcode(pc, country);
+                }
+                if (duplicates) add_duplicate_candidate(way, hno);
+                if (exporter) export_row(way.id(), 'w', centroid(way), way.tags(), hno);
+            }
+            else
+            {
+                const char *bdy = way.tags().get_value_by_key("boundary");
+                if (bdy && !strcmp(bdy, "postal_code")) 
+                {
+                    postcode_boundaries++;
+                    const char *ref = way.tags().get_value_by_key("ref");
+                    if (ref) add_postcode(ref, nullptr);
+                }
+            }
+        }
+    }
+
+    void relation(const osmium::Relation& rel)
+    {
+        const char *bdy = rel.tags().get_value_by_key("boundary");
+        if (bdy && !strcmp(bdy, "postal_code")) 
+        {
+            postcode_boundaries++;
+            const char *ref = rel.tags().get_value_by_key("ref");
+            if (ref) add_postcode(ref, nullptr);
+        }
+    }
+
+    // collect the addresses for the duplicates report, memory is the
+    // budget for the in-memory part of the sort
+    void enable_duplicates(size_t memory, const std::string& tmpdir)
+    {
+        duplicates.reset(new ExternalSorter<AddressRecord>(memory, tmpdir));
+    }
+
+    // write all addresses with their locations to the exporter; the
+    // locations of the nodes listed in the store are recorded
+    void enable_export(AddressExport *exporter, LocationStore *locations)
+    {
+        this->exporter = exporter;
+        this->locations = locations;
+    }
+
+    // must be called once all nodes have been read
+    void resolve_interpolations()
+    {
+        for (const Interpolation& ip : pending_interpolations) interpolate(ip);
+        if (exporter) exporter->write(export_rows);
+        pending_interpolations.clear();
+        pending_interpolations.shrink_to_fit();
+        interior_nodes.clear();
+        interior_nodes.shrink_to_fit();
+    }
+
+    // adds the results of another handler that has processed a different
+    // part of the input; both must have resolved their interpolations
+    void merge(AddressCountHandler& other)
+    {
+        numbers_nodes_overall += other.numbers_nodes_overall;
+        numbers_nodes_withstreet += other.numbers_nodes_withstreet;
+        numbers_nodes_withcity += other.numbers_nodes_withcity;
+        numbers_nodes_withcountry += other.numbers_nodes_withcountry;
+        numbers_nodes_withpostcode += other.numbers_nodes_withpostcode;
+        numbers_ways_overall += other.numbers_ways_overall;
+        numbers_ways_withstreet += other.numbers_ways_withstreet;
+        numbers_ways_withcity += other.numbers_ways_withcity;
+        numbers_ways_withcountry += other.numbers_ways_withcountry;
+        numbers_ways_withpostcode += other.numbers_ways_withpostcode;
+        postcode_boundaries += other.postcode_boundaries;
+        interpolation_count += other.interpolation_count;
+        interpolation_error += other.interpolation_error;
+        numbers_through_interpolation += other.numbers_through_interpolation;
+        for (uint32_t i = 0; i < other.postcodes.size(); i++)
+        {
+            postcodes.insert(other.postcodes.get(i), other.postcodes.length(i));
+        }
+        for (uint32_t i = 0; i < other.countries.size(); i++)
+        {
+            uint32_t c = countries.insert(other.countries.get(i), other.countries.length(i));
+            if (c == country_postcodes.size()) country_postcodes.emplace_back(12);
+            country_postcodes[c].merge(other.country_postcodes[i]);
+        }
+        if (duplicates) duplicates->take_runs(*other.duplicates);
+    }
+
+    // Saves or restores the counters, post codes and pending
+    // interpolations (see checkpoint.hpp). The --duplicates and --export
+    // output is not included.
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        archive.field(numbers_nodes_overall);
+        archive.field(numbers_nodes_withstreet);
+        archive.field(numbers_nodes_withcity);
+        archive.field(numbers_nodes_withcountry);
+        archive.field(numbers_nodes_withpostcode);
+        archive.field(numbers_ways_overall);
+        archive.field(numbers_ways_withstreet);
+        archive.field(numbers_ways_withcity);
+        archive.field(numbers_ways_withcountry);
+        archive.field(numbers_ways_withpostcode);
+        archive.field(postcode_boundaries);
+        archive.field(interpolation_count);
+        archive.field(interpolation_error);
+        archive.field(numbers_through_interpolation);
+        postcodes.checkpoint(archive);
+        archive.field(pending_interpolations);
+        archive.field(interior_nodes);
+        interpolation_modes.checkpoint(archive);
+        interpolation_tags.checkpoint(archive);
+        countries.checkpoint(archive);
+        uint64_t sketches = country_postcodes.size();
+        archive.field(sketches);
+        country_postcodes.resize(sketches, HyperLogLog(12));
+        for (HyperLogLog& h : country_postcodes) h.checkpoint(archive);
+    }
+
+    void print() {
+        std::cout << "                      nodes      ways      total" << std::endl;
+        std::cout << "with house number   " << numbers_ways_overall         << "   " << numbers_nodes_overall       << "   " << numbers_ways_overall                                    << std::endl;
+        std::cout << "... and street      " << numbers_nodes_withstreet     << "   " << numbers_ways_withstreet     << "   " << numbers_nodes_withstreet + numbers_ways_withstreet      << std::endl;
+        std::cout << "... and city        " << numbers_nodes_withcity       << "   " << numbers_ways_withcity       << "   " << numbers_nodes_withcity + numbers_ways_withcity          << std::endl;
+        std::cout << "... and post code   " << numbers_nodes_withpostcode   << "   " << numbers_ways_withpostcode   << "   " << numbers_nodes_withpostcode + numbers_ways_withcountry   << std::endl;
+        std::cout << "... and country     " << numbers_nodes_withcountry    << "   " << numbers_ways_withcountry    << "   " << numbers_nodes_withcountry + numbers_ways_withcountry    << std::endl;
+        std::cout << "\ntotal interpolations: " << interpolation_count << " (" << interpolation_error << " ignored)" << std::endl;
+        std::cout << "\nhouse numbers added through interpolation: " << numbers_through_interpolation << std::endl;
+        std::cout << "\ngrand total (interpolation, ways, nodes): " << numbers_through_interpolation + numbers_nodes_overall + numbers_ways_overall << std::endl;
+        if (approx)
+        {
+            HyperLogLog all(12);
+            for (const HyperLogLog& h : country_postcodes) all.merge(h);
+            std::cout << "\nnumber of different post codes (approx.): " << (size_t) all.estimate() << std::endl;
+            for (size_t c = 0; c < country_postcodes.size(); c++)
+            {
+                std::cout << "    addr:country=" << (*countries.get(c) ? countries.get(c) : "(none)") << ": " << (size_t) country_postcodes[c].estimate() << std::endl;
+            }
+        }
+        else
+        {
+            std::cout << "\nnumber of different post codes: " << postcodes.size() << std::endl;
+        }
+        std::cout << "\nnumber of post code boundaries: " << postcode_boundaries << std::endl;
+        if (duplicates) print_duplicates();
+    }
+
+    void print_duplicates()
+    {
+        const size_t max_samples = 10;
+        const size_t max_sample_objects = 5;
+        size_t addresses = 0;
+        size_t objects = 0;
+        std::vector<std::vector<uint64_t>> samples;
+
+        AddressRecord run = AddressRecord();
+        size_t run_length = 0;
+        auto end_run = [&]() {
+            if (run_length < 2) return;
+            addresses++;
+            objects += run_length;
+        };
+        bool sampled = false;
+        duplicates->merge([&](const AddressRecord& r) {
+            if (run_length && r.same_address(run))
+            {
+                run_length++;
+                if (run_length == 2 && samples.size() < max_samples)
+                {
+                    samples.push_back(std::vector<uint64_t>{run.object});
+                    sampled = true;
+                }
+                if (sampled && samples.back().size() < max_sample_objects) samples.back().push_back(r.object);
+            }
+            else
+            {
+                end_run();
+                run = r;
+                run_length = 1;
+                sampled = false;
+            }
+        });
+        end_run();
+
+        std::cout << "\naddresses occurring more than once: " << addresses << " (on " << objects << " objects)" << std::endl;
+        for (const auto& sample : samples)
+        {
+            std::cout << "   ";
+            for (uint64_t object : sample)
+            {
+                std::cout << " ";
+                print_object(object);
+            }
+            std::cout << std::endl;
+        }
+    }
+
+};
+
+#endif // ADDRESS_COUNT_HANDLER_HPP
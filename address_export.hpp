@@ -0,0 +1,245 @@
+#ifndef ADDRESS_EXPORT_HPP
+#define ADDRESS_EXPORT_HPP
+
+/*
+  Columnar binary export of address objects, written by count_addresses
+  --export. Worker threads collect rows into AddressRowGroup buffers of
+  their own and hand full groups to the shared AddressExport, which
+  dictionary-encodes the strings and appends the columns to the file in
+  large sequential writes.
+
+  File layout (all numbers in host byte order):
+
+    header      "OSMADDR\0", uint32 version (1), uint32 reserved (0)
+    row groups  uint32 n
+                int64  id[n]
+                char   type[n]           'n' node, 'w' way, 'i' interpolated
+                                         house number (id is the way id)
+                int32  x[n], y[n]        location in 1e-7 degrees, way
+                                         centroid for ways; invalid
+                                         locations are 0x7fffffff
+                uint32 street[n], city[n], postcode[n], housenumber[n]
+                                         ids into the dictionaries
+    dictionaries street, city, postcode, housenumber; each is a uint32
+                count followed by count strings (uint32 length, bytes).
+                Id 0 is always the empty string (value missing).
+    footer      uint64 dictionary offset, uint64 number of rows, "OSMADDR\0"
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <osmium/osm.hpp>
+
+#include "string_set.hpp"
+
+class AddressRowGroup
+{
+
+    friend class AddressExport;
+
+private:
+    static const uint32_t missing = UINT32_MAX;
+
+    std::vector<int64_t> ids;
+    std::vector<char> types;
+    std::vector<int32_t> xs;
+    std::vector<int32_t> ys;
+    // offsets into 'strings' for street, city, postcode, housenumber
+    std::vector<uint32_t> string_offsets;
+    std::string strings;
+
+    void add_string(const char *s)
+    {
+        uint32_t offset = missing;
+        if (s)
+        {
+            offset = strings.size();
+            strings.append(s);
+            strings.push_back(0);
+        }
+        string_offsets.push_back(offset);
+    }
+
+public:
+
+    static const size_t max_rows = 64 * 1024;
+
+    void add(int64_t id, char type, const osmium::Location& location, const char *street, const char *city, const char *postcode, const char *housenumber)
+    {
+        ids.push_back(id);
+        types.push_back(type);
+        xs.push_back(location.x());
+        ys.push_back(location.y());
+        add_string(street);
+        add_string(city);
+        add_string(postcode);
+        add_string(housenumber);
+    }
+
+    size_t size() const
+    {
+        return ids.size();
+    }
+
+    bool full() const
+    {
+        return ids.size() >= max_rows;
+    }
+
+    void clear()
+    {
+        ids.clear();
+        types.clear();
+        xs.clear();
+        ys.clear();
+        string_offsets.clear();
+        strings.clear();
+    }
+
+};
+
+/* ================================================== */
+
+class AddressExport
+{
+
+private:
+    static const size_t buffer_size = 16 * 1024 * 1024;
+
+    int fd;
+    std::vector<char> buffer;
+    uint64_t offset = 0;
+    uint64_t rows = 0;
+    StringSet dictionaries[4];
+    std::vector<uint32_t> column;
+    std::mutex mutex;
+
+    void flush()
+    {
+        const char *p = buffer.data();
+        size_t left = buffer.size();
+        while (left)
+        {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("error writing export file: ") + strerror(errno));
+            }
+            p += n;
+            left -= n;
+        }
+        buffer.clear();
+    }
+
+    void append(const void *data, size_t size)
+    {
+        if (buffer.size() + size > buffer_size) flush();
+        if (size > buffer_size)
+        {
+            buffer.insert(buffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+            flush();
+        }
+        else
+        {
+            buffer.insert(buffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+        }
+        offset += size;
+    }
+
+    template <typename T>
+    void append_value(T value)
+    {
+        append(&value, sizeof(T));
+    }
+
+public:
+
+    AddressExport(const std::string& filename)
+    {
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) throw std::runtime_error("can not open export file " + filename + ": " + strerror(errno));
+        buffer.reserve(buffer_size);
+        for (StringSet& d : dictionaries) d.insert("");
+        append("OSMADDR", 8);
+        append_value<uint32_t>(1);
+        append_value<uint32_t>(0);
+    }
+
+    AddressExport(const AddressExport&) = delete;
+    AddressExport& operator=(const AddressExport&) = delete;
+
+    ~AddressExport()
+    {
+        if (fd >= 0) ::close(fd);
+    }
+
+    // appends the rows of the group to the file and clears the group;
+    // may be called from several threads
+    void write(AddressRowGroup& group)
+    {
+        if (!group.size()) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t n = group.size();
+        append_value<uint32_t>(n);
+        append(group.ids.data(), n * sizeof(int64_t));
+        append(group.types.data(), n);
+        append(group.xs.data(), n * sizeof(int32_t));
+        append(group.ys.data(), n * sizeof(int32_t));
+        for (size_t d = 0; d < 4; d++)
+        {
+            column.clear();
+            for (size_t i = d; i < group.string_offsets.size(); i += 4)
+            {
+                uint32_t o = group.string_offsets[i];
+                column.push_back(o == AddressRowGroup::missing ? 0 : dictionaries[d].insert(group.strings.data() + o));
+            }
+            append(column.data(), n * sizeof(uint32_t));
+        }
+        rows += n;
+        group.clear();
+    }
+
+    // writes dictionaries and footer and closes the file
+    void close()
+    {
+        uint64_t dictionary_offset = offset;
+        for (const StringSet& d : dictionaries)
+        {
+            append_value<uint32_t>(d.size());
+            for (uint32_t i = 0; i < d.size(); i++)
+            {
+                append_value<uint32_t>(d.length(i));
+                append(d.get(i), d.length(i));
+            }
+        }
+        append_value<uint64_t>(dictionary_offset);
+        append_value<uint64_t>(rows);
+        append("OSMADDR", 8);
+        flush();
+        if (::close(fd)) throw std::runtime_error(std::string("error closing export file: ") + strerror(errno));
+        fd = -1;
+    }
+
+    uint64_t size() const
+    {
+        return rows;
+    }
+
+};
+
+#endif // ADDRESS_EXPORT_HPP
@@ -0,0 +1,138 @@
+/*
+  Writes a synthetic OSM file for benchmarking. The output only depends
+  on the options, so files of the same size and seed can be compared
+  across versions of the tools (see synthetic.hpp and run_bench.sh).
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cstdlib>
+#include <iostream>
+
+#include <getopt.h>
+
+#include <osmium/io/any_output.hpp>
+
+#include "synthetic.hpp"
+
+/* ================================================== */
+
+// rough number of nodes per megabyte of PBF output with the default
+// feature mix
+const uint64_t nodes_per_mb = 80000;
+
+void usage(const char *prg)
+{
+    std::cerr << "Usage: " << prg << " [OPTIONS] OUTFILE" << std::endl;
+    std::cerr << "  -s, --size MB           approximate size of the output as PBF (default: 10)" << std::endl;
+    std::cerr << "  -n, --nodes N           number of nodes, overrides --size" << std::endl;
+    std::cerr << "  -S, --seed N            seed of the random number generator (default: 42)" << std::endl;
+    std::cerr << "  --roads, --buildings, --addresses, --interpolations, --pois, --multipolygons N" << std::endl;
+    std::cerr << "                          share of features of this kind in per mille" << std::endl;
+    std::cerr << "The number of nodes, ways and relations written is printed to stdout." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    static struct option long_options[] = {
+        {"addresses", required_argument, 0, 'A'},
+        {"buildings", required_argument, 0, 'B'},
+        {"help", no_argument, 0, 'h'},
+        {"interpolations", required_argument, 0, 'I'},
+        {"multipolygons", required_argument, 0, 'P'},
+        {"nodes", required_argument, 0, 'n'},
+        {"pois", required_argument, 0, 'O'},
+        {"roads", required_argument, 0, 'R'},
+        {"seed", required_argument, 0, 'S'},
+        {"size", required_argument, 0, 's'},
+        {0, 0, 0, 0}
+    };
+
+    SyntheticParameters params;
+    params.nodes = 10 * nodes_per_mb;
+
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "hn:s:S:", long_options, 0);
+        if (c == -1) break;
+
+        switch (c)
+        {
+            case 'A':
+                params.addresses = atoi(optarg);
+                break;
+            case 'B':
+                params.buildings = atoi(optarg);
+                break;
+            case 'I':
+                params.interpolations = atoi(optarg);
+                break;
+            case 'P':
+                params.multipolygons = atoi(optarg);
+                break;
+            case 'O':
+                params.pois = atoi(optarg);
+                break;
+            case 'R':
+                params.roads = atoi(optarg);
+                break;
+            case 'n':
+                params.nodes = strtoull(optarg, nullptr, 10);
+                break;
+            case 's':
+                params.nodes = strtoull(optarg, nullptr, 10) * nodes_per_mb;
+                break;
+            case 'S':
+                params.seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            default:
+                exit(1);
+        }
+    }
+
+    if (argc - optind != 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (params.roads + params.buildings + params.addresses + params.interpolations + params.pois + params.multipolygons > 1000)
+    {
+        std::cerr << "the feature shares add up to more than 1000 per mille" << std::endl;
+        exit(1);
+    }
+    if (params.nodes < 1)
+    {
+        std::cerr << "nothing to write" << std::endl;
+        exit(1);
+    }
+
+    osmium::io::File outfile(argv[optind]);
+    osmium::io::Header header;
+    header.set("generator", "gen_synthetic");
+    osmium::io::Writer writer(outfile, header, osmium::io::overwrite::allow);
+
+    const size_t buffer_size = 16 * 1024 * 1024;
+    osmium::memory::Buffer buffer(buffer_size);
+    SyntheticGenerator generator(params, buffer);
+
+    auto flush = [&writer](osmium::memory::Buffer& b) {
+        if (b.committed() == 0) return;
+        writer(std::move(b));
+        b = osmium::memory::Buffer(buffer_size);
+    };
+    generator.run(SyntheticGenerator::phase::nodes, flush);
+    generator.run(SyntheticGenerator::phase::ways, flush);
+    generator.run(SyntheticGenerator::phase::relations, flush);
+    writer.close();
+
+    std::cout << "nodes " << generator.node_count << std::endl;
+    std::cout << "ways " << generator.way_count << std::endl;
+    std::cout << "relations " << generator.relation_count << std::endl;
+}
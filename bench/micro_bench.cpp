@@ -0,0 +1,166 @@
+/*
+  Micro-benchmarks for the per-object work of the tools: the tag
+  classification and way length computation of osmstats and the
+  condition check of osmgrep. The objects come from the synthetic data
+  generator. The results are printed as a JSON array.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <getopt.h>
+
+#include <osmium/osm.hpp>
+#include <osmium/handler.hpp>
+#include <osmium/visitor.hpp>
+
+#include "../osmgrep_filter.hpp"
+#include "../statistics_handler.hpp"
+#include "synthetic.hpp"
+
+/* ================================================== */
+
+double min_seconds = 1.0;
+bool first_result = true;
+
+// keeps the compiler from optimizing away the work
+volatile double sink;
+
+// Calls func() until min_seconds have passed and prints the time per
+// object; func() handles ops objects per call.
+template <typename TFunc>
+void run(const char *name, size_t ops, TFunc func)
+{
+    using clock = std::chrono::steady_clock;
+    size_t rounds = 0;
+    double elapsed;
+    clock::time_point start = clock::now();
+    do
+    {
+        sink = sink + func();
+        rounds++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_seconds);
+
+    std::cout << (first_result ? "[\n" : ",\n");
+    first_result = false;
+    std::cout << "  {\"name\": \"" << name << "\", \"ops\": " << rounds * ops <<
+        ", \"seconds\": " << elapsed << ", \"ns_per_op\": " << elapsed * 1e9 / (rounds * ops) << "}";
+}
+
+void usage(const char *prg)
+{
+    std::cerr << "Usage: " << prg << " [-n NODES] [-t SECONDS]" << std::endl;
+    std::cerr << "  -n, --nodes N       size of the synthetic data set (default: 200000)" << std::endl;
+    std::cerr << "  -t, --time SECONDS  minimum run time of each benchmark (default: 1)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"nodes", required_argument, 0, 'n'},
+        {"time", required_argument, 0, 't'},
+        {0, 0, 0, 0}
+    };
+
+    SyntheticParameters params;
+    params.nodes = 200000;
+
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "hn:t:", long_options, 0);
+        if (c == -1) break;
+
+        switch (c)
+        {
+            case 'n':
+                params.nodes = strtoull(optarg, nullptr, 10);
+                break;
+            case 't':
+                min_seconds = atof(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            default:
+                exit(1);
+        }
+    }
+
+    // all objects in one buffer, with the node locations filled in
+    osmium::memory::Buffer buffer(16 * 1024 * 1024, osmium::memory::Buffer::auto_grow::yes);
+    SyntheticGenerator generator(params, buffer);
+    auto nothing = [](osmium::memory::Buffer&) {};
+    generator.run(SyntheticGenerator::phase::nodes, nothing);
+    generator.run(SyntheticGenerator::phase::ways, nothing);
+    generator.run(SyntheticGenerator::phase::relations, nothing);
+
+    index_type index;
+    location_handler_type location_handler(index);
+    osmium::apply(buffer, location_handler);
+
+    std::vector<const osmium::OSMObject*> objects;
+    std::vector<const osmium::Way*> ways;
+    for (auto it = buffer.begin<osmium::OSMObject>(); it != buffer.end<osmium::OSMObject>(); ++it)
+    {
+        objects.push_back(&*it);
+        if (it->type() == osmium::item_type::way) ways.push_back(static_cast<const osmium::Way*>(&*it));
+    }
+
+    StatisticsHandler stat_handler;
+
+    run("osmstats count_misc", objects.size(), [&]() {
+        for (const osmium::OSMObject* object : objects) stat_handler.count_misc(object->tags());
+        return 0.0;
+    });
+
+    run("osmstats way", ways.size(), [&]() {
+        for (const osmium::Way* way : ways) stat_handler.way(*way);
+        return 0.0;
+    });
+
+    // the length computation alone, as done by StatisticsHandler::waylen
+    run("osmstats waylen", ways.size(), [&]() {
+        double length = 0;
+        for (const osmium::Way* way : ways) length += osmium::geom::haversine::distance(way->nodes());
+        return length;
+    });
+
+    // a few typical osmgrep command lines
+    struct GrepCase
+    {
+        const char *name;
+        const char *type;
+        std::vector<std::string> expressions;
+    };
+    std::vector<GrepCase> cases = {
+        { "osmgrep match highway=*", nullptr, { "highway=*" } },
+        { "osmgrep match way highway=residential", "way", { "highway=residential" } },
+        { "osmgrep match name~Street 1", nullptr, { "name~Street 1" } },
+        { "osmgrep match maxspeed>50", nullptr, { "maxspeed>50" } },
+        { "osmgrep match 5 expressions", nullptr, { "amenity=cafe", "amenity=pub", "shop=*", "building:levels>=10", "addr:street~^Street 19" } }
+    };
+    for (const GrepCase& c : cases)
+    {
+        GrepFilter filter;
+        if (c.type) filter.add_type(c.type);
+        for (const std::string& e : c.expressions) filter.tag_filter.add(e);
+        filter.compile();
+        run(c.name, objects.size(), [&]() {
+            size_t matches = 0;
+            for (const osmium::OSMObject* object : objects) matches += filter.match(*object);
+            return static_cast<double>(matches);
+        });
+    }
+
+    std::cout << "\n]" << std::endl;
+}
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+#  Runs the tools on synthetic data and writes throughput, objects per
+#  second and peak memory of every run, plus the micro-benchmarks, to a
+#  JSON file. Called by "make bench".
+#
+#  Usage: bench/run_bench.sh [RESULTS.json]
+#
+#  BENCH_SIZES    sizes of the synthetic files in MB (default: "10 100 1000")
+#  BENCH_SEED     seed for the generator (default: 42)
+#  BENCH_DATA     where the synthetic files are kept (default: bench/data)
+#  BENCH_THREADS  threads for the multi-threaded runs (default: number of CPUs)
+#  BENCH_TIME     GNU time, needed for the memory measurements
+#                 (default: /usr/bin/time)
+#
+
+set -e
+
+SIZES=${BENCH_SIZES:-"10 100 1000"}
+SEED=${BENCH_SEED:-42}
+DATA=${BENCH_DATA:-bench/data}
+THREADS=${BENCH_THREADS:-$(nproc 2>/dev/null || echo 4)}
+RESULTS=${1:-bench/results/$(git rev-parse --short HEAD 2>/dev/null || echo unknown).json}
+
+TIME=${BENCH_TIME:-/usr/bin/time}
+if ! $TIME -f %M -o /dev/null true >/dev/null 2>&1; then
+    echo "GNU time is needed as $TIME" >&2
+    exit 1
+fi
+
+mkdir -p "$DATA" "$(dirname "$RESULTS")"
+TMP=$(mktemp)
+trap 'rm -f "$TMP" "$TMP.out" "$TMP.osm.pbf"' EXIT
+
+SEPARATOR=""
+{
+    echo "{"
+    echo "  \"commit\": \"$(git rev-parse HEAD 2>/dev/null || echo unknown)\","
+    echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+    echo "  \"host\": \"$(uname -n)\","
+    echo "  \"threads\": $THREADS,"
+    echo "  \"runs\": ["
+} > "$RESULTS"
+
+# run NAME FILE COMMAND...
+run() {
+    name=$1
+    file=$2
+    shift 2
+    echo "$name: $*" >&2
+    $TIME -f "%e %M" -o "$TMP" "$@" > "$TMP.out"
+    read seconds rss < "$TMP"
+    bytes=$(wc -c < "$file")
+    objects=$(awk '{ n += $2 } END { print n }' "$file.counts")
+    awk -v name="$name" -v file="$(basename "$file")" -v s="$seconds" -v rss="$rss" \
+        -v bytes="$bytes" -v objects="$objects" -v sep="$SEPARATOR" 'BEGIN {
+        if (s <= 0) s = 0.001
+        printf "%s    {\"name\": \"%s\", \"input\": \"%s\", \"bytes\": %d, \"objects\": %d, \"seconds\": %.2f, \"mb_per_second\": %.2f, \"objects_per_second\": %.0f, \"peak_rss_kb\": %d}",
+            sep, name, file, bytes, objects, s, bytes / s / 1e6, objects / s, rss
+    }' >> "$RESULTS"
+    SEPARATOR=",
+"
+}
+
+for size in $SIZES; do
+    file=$DATA/synthetic-$size-$SEED.osm.pbf
+    if [ ! -f "$file" ] || [ ! -f "$file.counts" ]; then
+        echo "generating $file" >&2
+        bench/gen_synthetic --size "$size" --seed "$SEED" "$file" > "$file.counts"
+    fi
+
+    run "osmstats" "$file" ./osmstats "$file"
+    run "count_addresses" "$file" ./count_addresses "$file"
+    run "count_addresses --threads" "$file" ./count_addresses --threads "$THREADS" "$file"
+    run "count_addresses --approx" "$file" ./count_addresses --approx "$file"
+    run "count_addresses --duplicates" "$file" ./count_addresses --duplicates "$file"
+    run "osmgrep highway=*" "$file" ./osmgrep --expr 'highway=*' "$file"
+    run "osmgrep name~ maxspeed>" "$file" ./osmgrep --expr 'name~^Street 1' --expr 'maxspeed>50' "$file"
+    run "osmgrep --output" "$file" ./osmgrep --type way --expr 'highway=*' --output "$TMP.osm.pbf" "$file"
+    rm -f "$TMP.osm.pbf"
+    run "osmcombined" "$file" ./osmcombined --stats --addresses --grep --grep-expr 'highway=*' "$file"
+done
+
+{
+    echo
+    echo "  ],"
+    echo "  \"micro\":"
+    bench/micro_bench | sed 's/^/  /'
+    echo "}"
+} >> "$RESULTS"
+
+echo "results written to $RESULTS" >&2
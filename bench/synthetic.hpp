@@ -0,0 +1,349 @@
+#ifndef BENCH_SYNTHETIC_HPP
+#define BENCH_SYNTHETIC_HPP
+
+/*
+  Deterministic generator for synthetic OSM data, used by the
+  benchmarks. The data consists of "features" (roads, buildings,
+  addresses, interpolations, POIs, multipolygons) made of consecutive
+  nodes. The same seed always produces the same data, on all platforms.
+
+  Nodes, ways and relations have to be written in this order, so the
+  generator is run once per object type (see run()); as every run
+  replays the same random numbers, the ids match up.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cstdint>
+#include <string>
+
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm.hpp>
+
+// splitmix64, used instead of <random> whose distributions differ
+// between standard libraries
+class SyntheticRandom
+{
+
+private:
+    uint64_t state;
+
+public:
+
+    SyntheticRandom(uint64_t seed) : state(seed) {
+    }
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, n)
+    uint32_t below(uint32_t n)
+    {
+        return next() % n;
+    }
+
+    // uniform in [0, 1)
+    double unit()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+};
+
+/* ================================================== */
+
+struct SyntheticParameters
+{
+    uint64_t seed = 42;
+    uint64_t nodes = 1000000;
+
+    // share of features of each kind, in per mille of all features;
+    // the rest are plain untagged nodes
+    unsigned int roads = 150;
+    unsigned int buildings = 250;
+    unsigned int addresses = 200;
+    unsigned int interpolations = 20;
+    unsigned int pois = 100;
+    unsigned int multipolygons = 10;
+};
+
+class SyntheticGenerator
+{
+
+public:
+
+    enum class phase { nodes, ways, relations };
+
+    uint64_t node_count = 0;
+    uint64_t way_count = 0;
+    uint64_t relation_count = 0;
+
+private:
+
+    const SyntheticParameters& params;
+    SyntheticRandom rng;
+    phase current;
+    osmium::memory::Buffer& buffer;
+
+    uint64_t node_id = 0;
+    uint64_t way_id = 0;
+    uint64_t relation_id = 0;
+
+    double lon = 0;
+    double lat = 0;
+
+    // the attributes come from a generator of their own, so that
+    // every phase consumes the same random numbers from rng
+    template <typename TBuilder>
+    static void set_attributes(TBuilder& builder, uint64_t id, SyntheticRandom attributes)
+    {
+        builder.object().set_id(id);
+        builder.object().set_version(1 + attributes.below(5));
+        builder.object().set_changeset(1 + attributes.below(100000));
+        builder.object().set_uid(1 + attributes.below(5000));
+        builder.object().set_timestamp(1300000000 + attributes.below(200000000));
+        builder.add_user("synthetic");
+    }
+
+    // adds a node near the previous one (or somewhere in the bounding
+    // box if jump is set); tags are given as key, value, key, value ...
+    uint64_t node(bool jump, std::initializer_list<std::string> tags = {})
+    {
+        if (jump)
+        {
+            lon = 5.0 + rng.unit() * 10.0;
+            lat = 47.0 + rng.unit() * 8.0;
+        }
+        else
+        {
+            lon += (rng.unit() - 0.5) * 0.002;
+            lat += (rng.unit() - 0.5) * 0.002;
+        }
+        ++node_id;
+        uint64_t attributes = rng.next();
+        if (current == phase::nodes)
+        {
+            {
+                osmium::builder::NodeBuilder builder(buffer);
+                set_attributes(builder, node_id, SyntheticRandom(attributes));
+                builder.object().set_location(osmium::Location(lon, lat));
+                add_tags(buffer, builder, tags);
+            }
+            buffer.commit();
+            node_count++;
+        }
+        return node_id;
+    }
+
+    template <typename TBuilder>
+    static void add_tags(osmium::memory::Buffer& buffer, TBuilder& builder, std::initializer_list<std::string> tags)
+    {
+        if (!tags.size()) return;
+        osmium::builder::TagListBuilder tl(buffer, &builder);
+        for (auto it = tags.begin(); it != tags.end() && it + 1 != tags.end(); it += 2)
+        {
+            if (!it->empty() && !(it + 1)->empty()) tl.add_tag(*it, *(it + 1));
+        }
+    }
+
+    uint64_t way(uint64_t first, uint64_t last, bool closed, std::initializer_list<std::string> tags)
+    {
+        ++way_id;
+        uint64_t attributes = rng.next();
+        if (current == phase::ways)
+        {
+            {
+                osmium::builder::WayBuilder builder(buffer);
+                set_attributes(builder, way_id, SyntheticRandom(attributes));
+                {
+                    osmium::builder::WayNodeListBuilder wnl(buffer, &builder);
+                    for (uint64_t id = first; id <= last; id++) wnl.add_node_ref(osmium::NodeRef(id));
+                    if (closed) wnl.add_node_ref(osmium::NodeRef(first));
+                }
+                add_tags(buffer, builder, tags);
+            }
+            buffer.commit();
+            way_count++;
+        }
+        return way_id;
+    }
+
+    void multipolygon(uint64_t outer, uint64_t inner, std::initializer_list<std::string> tags)
+    {
+        ++relation_id;
+        uint64_t attributes = rng.next();
+        if (current == phase::relations)
+        {
+            {
+                osmium::builder::RelationBuilder builder(buffer);
+                set_attributes(builder, relation_id, SyntheticRandom(attributes));
+                {
+                    osmium::builder::RelationMemberListBuilder rml(buffer, &builder);
+                    rml.add_member(osmium::item_type::way, outer, "outer");
+                    rml.add_member(osmium::item_type::way, inner, "inner");
+                }
+                add_tags(buffer, builder, tags);
+            }
+            buffer.commit();
+            relation_count++;
+        }
+    }
+
+    template <size_t N>
+    const char *pick(const char *const (&values)[N])
+    {
+        return values[rng.below(N)];
+    }
+
+    std::string street()
+    {
+        return "Street " + std::to_string(rng.below(2000));
+    }
+
+    std::string postcode()
+    {
+        return std::to_string(10000 + rng.below(1000) * 89);
+    }
+
+    std::string city()
+    {
+        return "City " + std::to_string(rng.below(200));
+    }
+
+    uint64_t ring(unsigned int n, std::initializer_list<std::string> tags)
+    {
+        uint64_t first = node(false);
+        for (unsigned int i = 1; i < n; i++) node(false);
+        return way(first, node_id, true, tags);
+    }
+
+    void feature()
+    {
+        static const char *const highways[] = { "motorway", "trunk", "primary", "secondary", "tertiary", "unclassified", "residential", "residential", "residential", "service", "footway", "path", "track", "cycleway" };
+        static const char *const amenities[] = { "restaurant", "cafe", "fast_food", "pub", "bar", "fuel", "parking", "place_of_worship", "school", "kindergarten", "hospital", "post_office", "atm", "bank", "bench", "toilets" };
+        static const char *const tourism[] = { "hotel", "motel", "camp_site", "hostel", "museum", "viewpoint" };
+        static const char *const landuses[] = { "forest", "grass", "meadow", "residential", "industrial", "commercial", "farmland", "farmyard" };
+
+        unsigned int r = rng.below(1000);
+        bool jump = rng.below(8) == 0;
+
+        if (r < params.roads)
+        {
+            const char *hwy = pick(highways);
+            std::string name = rng.below(2) ? street() : "";
+            std::string maxspeed = rng.below(3) ? std::to_string(10 * (3 + rng.below(11))) : "";
+            unsigned int n = 2 + rng.below(19);
+            uint64_t first = node(jump);
+            for (unsigned int i = 1; i < n; i++) node(false);
+            way(first, node_id, false, { "highway", hwy, "name", name, "maxspeed", maxspeed });
+            return;
+        }
+        r -= params.roads;
+
+        if (r < params.buildings)
+        {
+            node(jump);
+            std::string hno = rng.below(3) ? "" : std::to_string(1 + rng.below(200));
+            std::string s = hno.empty() ? "" : street();
+            std::string levels = rng.below(4) ? "" : std::to_string(1 + rng.below(20));
+            unsigned int n = 4 + rng.below(4);
+            ring(n, { "building", "yes", "addr:housenumber", hno, "addr:street", s, "building:levels", levels });
+            return;
+        }
+        r -= params.buildings;
+
+        if (r < params.addresses)
+        {
+            node(jump, { "addr:housenumber", std::to_string(1 + rng.below(200)), "addr:street", street(), "addr:postcode", postcode(), "addr:city", city(), "addr:country", rng.below(10) ? "DE" : "AT" });
+            return;
+        }
+        r -= params.addresses;
+
+        if (r < params.interpolations)
+        {
+            unsigned int from = 2 * (1 + rng.below(50));
+            unsigned int to = from + 2 * (2 + rng.below(20));
+            std::string s = street();
+            std::string mode = rng.below(4) ? "even" : "all";
+            uint64_t first = node(jump, { "addr:housenumber", std::to_string(from), "addr:street", s });
+            unsigned int n = rng.below(3);
+            for (unsigned int i = 0; i < n; i++) node(false);
+            node(false, { "addr:housenumber", std::to_string(to), "addr:street", s });
+            way(first, node_id, false, { "addr:interpolation", mode });
+            return;
+        }
+        r -= params.interpolations;
+
+        if (r < params.pois)
+        {
+            switch (rng.below(4))
+            {
+                case 0:
+                    node(jump, { "amenity", pick(amenities), "name", "POI" });
+                    break;
+                case 1:
+                    node(jump, { "shop", "supermarket", "name", "Shop" });
+                    break;
+                case 2:
+                    node(jump, { "tourism", pick(tourism) });
+                    break;
+                default:
+                    node(jump, { "place", "village", "name", city() });
+                    break;
+            }
+            return;
+        }
+        r -= params.pois;
+
+        if (r < params.multipolygons)
+        {
+            node(jump);
+            unsigned int n = 8 + rng.below(8);
+            uint64_t outer = ring(n, {});
+            uint64_t inner = ring(4, {});
+            multipolygon(outer, inner, { "type", "multipolygon", "landuse", pick(landuses) });
+            return;
+        }
+
+        node(jump);
+    }
+
+public:
+
+    SyntheticGenerator(const SyntheticParameters& params, osmium::memory::Buffer& buffer) :
+        params(params),
+        rng(params.seed),
+        current(phase::nodes),
+        buffer(buffer) {
+    }
+
+    // Generates the objects of one type. flush(buffer) is called
+    // whenever the buffer is getting full.
+    template <typename TFlush>
+    void run(phase p, TFlush flush)
+    {
+        current = p;
+        rng = SyntheticRandom(params.seed);
+        node_id = way_id = relation_id = 0;
+        lon = lat = 0;
+        while (node_id < params.nodes)
+        {
+            feature();
+            if (buffer.committed() > buffer.capacity() / 2) flush(buffer);
+        }
+        flush(buffer);
+    }
+
+};
+
+#endif // BENCH_SYNTHETIC_HPP
@@ -0,0 +1,152 @@
+#ifndef BLOCK_SAMPLE_HPP
+#define BLOCK_SAMPLE_HPP
+
+/*
+  Estimates from a random sample of the blocks of a PBF file, used by
+  osmstats --sample. Every block is read with the same probability f,
+  independently of the others. A total is estimated as the sum of the
+  values of the sampled blocks divided by f (Horvitz-Thompson), with
+  the variance (1 - f) / f^2 * sum(y_b^2) over the sampled blocks.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <osmium/geom/haversine.hpp>
+#include <osmium/osm.hpp>
+
+#include "hash.hpp"
+
+// whether block number 'index' is part of the sample; the decision
+// only depends on the seed and the index
+inline bool block_sampled(uint64_t seed, uint64_t index, double fraction)
+{
+    uint64_t h = hash_bytes(reinterpret_cast<const char *>(&index), sizeof(index), seed);
+    return (h >> 11) * (1.0 / 9007199254740992.0) < fraction;
+}
+
+/* ================================================== */
+
+/*
+  Locations of the nodes in the sampled blocks, with the number of the
+  block each node came from. Ways only get the segments whose end nodes
+  have both been sampled; a segment is weighted with the inverse of the
+  probability of that: 1/f if both nodes are in the same block, 1/f^2
+  otherwise.
+*/
+class SampledLocations
+{
+
+private:
+    struct Entry
+    {
+        osmium::unsigned_object_id_type id;
+        osmium::Location location;
+        uint32_t block;
+
+        bool operator<(const Entry& other) const
+        {
+            return id < other.id;
+        }
+    };
+
+    double fraction;
+    std::vector<Entry> entries;
+    bool sorted = true;
+
+    const Entry *find(osmium::unsigned_object_id_type id)
+    {
+        if (!sorted)
+        {
+            std::sort(entries.begin(), entries.end());
+            sorted = true;
+        }
+        Entry key{id, osmium::Location(), 0};
+        auto it = std::lower_bound(entries.begin(), entries.end(), key);
+        return (it == entries.end() || it->id != id) ? nullptr : &*it;
+    }
+
+public:
+
+    explicit SampledLocations(double fraction) : fraction(fraction) {
+    }
+
+    void add(osmium::unsigned_object_id_type id, const osmium::Location& location, uint32_t block)
+    {
+        if (!entries.empty() && id < entries.back().id) sorted = false;
+        entries.push_back(Entry{id, location, block});
+    }
+
+    // estimated length of the way in m
+    double length(const osmium::Way& way)
+    {
+        double sum = 0;
+        const Entry *previous = nullptr;
+        for (const osmium::NodeRef& nr : way.nodes())
+        {
+            const Entry *e = find(nr.positive_ref());
+            if (e && previous)
+            {
+                double d = osmium::geom::haversine::distance(osmium::geom::Coordinates(previous->location), osmium::geom::Coordinates(e->location));
+                sum += (e->block == previous->block) ? d / fraction : d / (fraction * fraction);
+            }
+            previous = e;
+        }
+        return sum;
+    }
+
+};
+
+/* ================================================== */
+
+/*
+  Collects the per-block values of a number of metrics. add_block() gets
+  the running totals before and after a sampled block.
+*/
+class BlockSampleEstimator
+{
+
+private:
+    double fraction;
+    std::vector<double> sums;
+    std::vector<double> squares;
+
+public:
+
+    BlockSampleEstimator(double fraction, size_t metrics) : fraction(fraction), sums(metrics, 0), squares(metrics, 0) {
+    }
+
+    void add_block(const std::vector<double>& before, const std::vector<double>& after)
+    {
+        for (size_t i = 0; i < sums.size(); i++)
+        {
+            double y = after[i] - before[i];
+            sums[i] += y;
+            squares[i] += y * y;
+        }
+    }
+
+    double total(size_t i) const
+    {
+        return sums[i] / fraction;
+    }
+
+    // half width of the 95% confidence interval of total(i); for the
+    // way lengths, which are themselves estimated within the block,
+    // this is the "ultimate cluster" approximation
+    double margin(size_t i) const
+    {
+        return 1.96 * std::sqrt((1 - fraction) / (fraction * fraction) * squares[i]);
+    }
+
+};
+
+#endif // BLOCK_SAMPLE_HPP
@@ -0,0 +1,229 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+/*
+  Checkpoints for long runs. The state of the handlers is written to a
+  file together with the input offset at which it was taken (a block
+  boundary, see pbf_blocks.hpp), so that an interrupted run can be
+  resumed from there with the same result.
+
+  Classes that can be saved have a method
+
+      template <typename TArchive> void checkpoint(TArchive& archive)
+
+  that passes all of their state to archive.field(). The same method
+  restores the state when given a CheckpointReader.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+const char checkpoint_magic[8] = { 'O', 'S', 'M', 'C', 'K', 'P', 'T', '1' };
+
+class CheckpointWriter
+{
+
+private:
+    std::string filename;
+    std::string tmpname;
+    FILE *file;
+
+    void put(const void *data, size_t size)
+    {
+        if (size && fwrite(data, size, 1, file) != 1) throw std::runtime_error("error writing " + tmpname + ": " + strerror(errno));
+    }
+
+public:
+
+    // The checkpoint is written to FILENAME.tmp first and only replaces
+    // the previous one in commit().
+    explicit CheckpointWriter(const std::string& filename) : filename(filename), tmpname(filename + ".tmp")
+    {
+        file = fopen(tmpname.c_str(), "wb");
+        if (!file) throw std::runtime_error("cannot create " + tmpname + ": " + strerror(errno));
+        put(checkpoint_magic, sizeof(checkpoint_magic));
+    }
+
+    ~CheckpointWriter()
+    {
+        if (file)
+        {
+            fclose(file);
+            unlink(tmpname.c_str());
+        }
+    }
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    bool loading() const
+    {
+        return false;
+    }
+
+    template <typename T>
+    void field(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint fields must be trivially copyable");
+        put(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void field(std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint fields must be trivially copyable");
+        uint64_t size = values.size();
+        put(&size, sizeof(size));
+        put(values.data(), size * sizeof(T));
+    }
+
+    void field(std::string& value)
+    {
+        uint64_t size = value.size();
+        put(&size, sizeof(size));
+        put(value.data(), size);
+    }
+
+    void commit()
+    {
+        if (fflush(file) || fsync(fileno(file))) throw std::runtime_error("error writing " + tmpname + ": " + strerror(errno));
+        fclose(file);
+        file = nullptr;
+        if (rename(tmpname.c_str(), filename.c_str())) throw std::runtime_error("cannot rename " + tmpname + ": " + strerror(errno));
+    }
+
+};
+
+class CheckpointReader
+{
+
+private:
+    std::string filename;
+    FILE *file;
+
+    void get(void *data, size_t size)
+    {
+        if (size && fread(data, size, 1, file) != 1) throw std::runtime_error(filename + " is truncated");
+    }
+
+public:
+
+    explicit CheckpointReader(const std::string& filename) : filename(filename)
+    {
+        file = fopen(filename.c_str(), "rb");
+        if (!file) throw std::runtime_error("cannot open " + filename + ": " + strerror(errno));
+        char magic[sizeof(checkpoint_magic)];
+        if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, checkpoint_magic, sizeof(magic)))
+        {
+            fclose(file);
+            throw std::runtime_error(filename + " is not a checkpoint file");
+        }
+    }
+
+    ~CheckpointReader()
+    {
+        fclose(file);
+    }
+
+    CheckpointReader(const CheckpointReader&) = delete;
+    CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+    bool loading() const
+    {
+        return true;
+    }
+
+    template <typename T>
+    void field(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint fields must be trivially copyable");
+        get(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void field(std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint fields must be trivially copyable");
+        uint64_t size;
+        get(&size, sizeof(size));
+        values.resize(size);
+        get(values.data(), size * sizeof(T));
+    }
+
+    void field(std::string& value)
+    {
+        uint64_t size;
+        get(&size, sizeof(size));
+        value.resize(size);
+        if (size) get(&value[0], size);
+    }
+
+};
+
+/* ================================================== */
+
+/*
+  First record of every checkpoint. A checkpoint is only resumed by the
+  program that wrote it, with the same settings and input file size.
+*/
+struct CheckpointInfo
+{
+    std::string program;
+    std::string settings;
+    uint64_t input_size = 0;
+    uint64_t offset = 0;
+
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        archive.field(program);
+        archive.field(settings);
+        archive.field(input_size);
+        archive.field(offset);
+    }
+
+    bool compatible(const CheckpointInfo& other) const
+    {
+        return program == other.program && settings == other.settings && input_size == other.input_size;
+    }
+};
+
+// due() returns true once every interval
+class CheckpointTimer
+{
+
+private:
+    time_t interval;
+    time_t last;
+
+public:
+
+    explicit CheckpointTimer(unsigned int minutes) : interval(minutes * 60), last(time(nullptr)) {
+    }
+
+    bool due()
+    {
+        time_t now = time(nullptr);
+        if (now - last < interval) return false;
+        last = now;
+        return true;
+    }
+
+};
+
+#endif // CHECKPOINT_HPP
@@ -19,219 +19,113 @@ Public Domain.
 
 
 #include <getopt.h>
+#include <unistd.h>
 
 #include <osmium/osm.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/handler.hpp>
 #include <osmium/visitor.hpp>
 
-#include <map>
-
-class AddressCountHandler : public osmium::handler::Handler
-{
-
-private:
-    std::map<osmium::unsigned_object_id_type, uint16_t> housenumberMap;
-    size_t numbers_nodes_overall = 0;
-    size_t numbers_nodes_withstreet = 0;
-    size_t numbers_nodes_withcity = 0;
-    size_t numbers_nodes_withcountry = 0;
-    size_t numbers_nodes_withpostcode = 0;
-    size_t numbers_ways_overall = 0;
-    size_t numbers_ways_withstreet = 0;
-    size_t numbers_ways_withcity = 0;
-    size_t numbers_ways_withcountry = 0;
-    size_t numbers_ways_withpostcode = 0;
-    size_t postcode_boundaries = 0;
-    size_t interpolation_count = 0;
-    size_t interpolation_error = 0;
-    size_t numbers_through_interpolation = 0;
-    std::map<std::string, bool> postcode;
-    bool debug;
-
-
-public:
-
-    AddressCountHandler(bool debug) : debug(debug){
-    }
-
-    void node(const osmium::Node& node)
-    {
-        const char *hno = node.tags().get_value_by_key("addr:housenumber");
-        if (hno)
-        {
-            housenumberMap[node.id()] = atoi(hno);
-            numbers_nodes_overall ++;
-            if (node.tags().get_value_by_key("addr:street")) numbers_nodes_withstreet ++;
-            if (node.tags().get_value_by_key("addr:city")) numbers_nodes_withcity ++;
-            if (node.tags().get_value_by_key("addr:country")) numbers_nodes_withcountry ++;
-            if (node.tags().get_value_by_key("addr:postcode"))
-            {
-                numbers_nodes_withpostcode ++;
-                postcode[node.tags().get_value_by_key("addr:postcode")] = true;
-            }
-        }
-    }
-
-    void way(const osmium::Way& way)
-    {
-        const char* inter = way.tags().get_value_by_key("addr:interpolation");
-        if (inter)
-        {
-            interpolation_count ++;
-            osmium::unsigned_object_id_type fromnode = way.nodes().front().ref();
-            osmium::unsigned_object_id_type tonode = way.nodes().back().ref();
-            uint16_t fromhouse = housenumberMap[fromnode];
-            uint16_t tohouse = housenumberMap[tonode];
-
-            // back out if we don't have both house numbers
-            if (!(fromhouse && tohouse)) 
-            {
-                interpolation_error++;
-                if (debug)
-                {
-
-                    if (!fromhouse) std::cerr << "interpolation way " << way.id() << " references node " << fromnode << " which has no addr:housenumber" << std::endl;
-                    if (!tohouse) std::cerr << "interpolation way " << way.id() << " references node " << tonode << " which has no addr:housenumber" << std::endl;
-                }
-                return;
-            }
-
-            // swap if range is backwards
-            if (tohouse < fromhouse) 
-            {
-                fromhouse = tohouse;
-                tohouse = housenumberMap[fromnode];
-            }
-
-            if (!strcmp(inter, "even"))
-            {
-                if ((fromhouse %2 == 1) || (tohouse %2 == 1))
-                {
-                    if (debug)
-                    {
-                        if (fromhouse%2==1) std::cerr << "interpolation way " << way.id() << " (addr:interpolation=even) references node " << fromnode << " which has an odd house number of " << fromhouse << std::endl;
-                        if (tohouse%2==1) std::cerr << "interpolation way " << way.id() << " (addr:interpolation=even) references node " << tonode << " which has an odd house number of " << tohouse << std::endl;
-                    }
-                    interpolation_error++;
-                    return;
-                }
-                numbers_through_interpolation += (tohouse - fromhouse) / 2 - 1;
-            }
-            else if (!strcmp(inter, "odd"))
-            {
-                if ((fromhouse %2 == 0) || (tohouse %2 == 0))
-                {
-                    if (debug)
-                    {
-                        if (fromhouse%2==1) std::cerr << "interpolation way " << way.id() << " (addr:interpolation=odd) references node " << fromnode << " which has an even house number of " << fromhouse << std::endl;
-                        if (tohouse%2==1) std::cerr << "interpolation way " << way.id() << " (addr:interpolation=odd) references node " << tonode << " which has an even house number of " << tohouse << std::endl;
-                    }
-                    interpolation_error++;
-                    return;
-                }
-                numbers_through_interpolation += (tohouse - fromhouse) / 2 - 1;
-            }
-            else if (!strcmp(inter, "both") || !strcmp(inter, "all"))
-            {
-                numbers_through_interpolation += (tohouse - fromhouse) - 1;
-            }
-            else
-            {
-                if (debug)
-                {
-                    std::cerr << "interpolation way " << way.id() << " has invalid interpolation mode '" << inter << "'" << std::endl;
-                }
-                interpolation_error++;
-            }
-            // slight error here - if interpolation way contains intermediate nodes with addresses then these are counted twice.
-        }
-        else
-        {
-            const char *hno = way.tags().get_value_by_key("addr:housenumber");
-            if (hno)
-            {
-                numbers_ways_overall ++;
-                if (way.tags().get_value_by_key("addr:street")) numbers_ways_withstreet ++;
-                if (way.tags().get_value_by_key("addr:city")) numbers_ways_withcity ++;
-                if (way.tags().get_value_by_key("addr:country")) numbers_ways_withcountry ++;
-                if (way.tags().get_value_by_key("addr:postcode"))
-                {
-                    numbers_ways_withpostcode ++;
-                    postcode[way.tags().get_value_by_key("addr:postcode")] = true;
-                }
-            }
-            else
-            {
-                const char *bdy = way.tags().get_value_by_key("boundary");
-                if (bdy && !strcmp(bdy, "postal_code")) 
-                {
-                    postcode_boundaries++;
-                    const char *ref = way.tags().get_value_by_key("ref");
-                    if (ref) postcode[ref]=true;
-                }
-            }
-        }
-    }
-
-    void relation(const osmium::Relation& rel)
-    {
-        const char *bdy = rel.tags().get_value_by_key("boundary");
-        if (bdy && !strcmp(bdy, "postal_code")) 
-        {
-            postcode_boundaries++;
-            const char *ref = rel.tags().get_value_by_key("ref");
-            if (ref) postcode[ref]=true;
-        }
-    }
-
-    void print() {
-        std::cout << "                      nodes      ways      total" << std::endl;
-        std::cout << "with house number   " << numbers_ways_overall         << "   " << numbers_nodes_overall       << "   " << numbers_ways_overall                                    << std::endl;
-        std::cout << "... and street      " << numbers_nodes_withstreet     << "   " << numbers_ways_withstreet     << "   " << numbers_nodes_withstreet + numbers_ways_withstreet      << std::endl;
-        std::cout << "... and city        " << numbers_nodes_withcity       << "   " << numbers_ways_withcity       << "   " << numbers_nodes_withcity + numbers_ways_withcity          << std::endl;
-        std::cout << "... and post code   " << numbers_nodes_withpostcode   << "   " << numbers_ways_withpostcode   << "   " << numbers_nodes_withpostcode + numbers_ways_withcountry   << std::endl;
-        std::cout << "... and country     " << numbers_nodes_withcountry    << "   " << numbers_ways_withcountry    << "   " << numbers_nodes_withcountry + numbers_ways_withcountry    << std::endl;
-        std::cout << "\ntotal interpolations: " << interpolation_count << " (" << interpolation_error << " ignored)" << std::endl;
-        std::cout << "\nhouse numbers added through interpolation: " << numbers_through_interpolation << std::endl;
-        std::cout << "\ngrand total (interpolation, ways, nodes): " << numbers_through_interpolation + numbers_nodes_overall + numbers_ways_overall << std::endl;
-        std::cout << "\nnumber of different post codes: " << postcode.size() << std::endl;
-        std::cout << "\nnumber of post code boundaries: " << postcode_boundaries << std::endl;
-    }
-
-};
+#include "address_count_handler.hpp"
+#include "checkpoint.hpp"
+#include "options.hpp"
+#include "parallel_apply.hpp"
+#include "parallel_input.hpp"
+#include "pbf_blocks.hpp"
 
 /* ================================================== */
 
 void usage(const char *prg)
 {
-    std::cerr << "Usage: " << prg << " [-d] [-h] OSMFILE" << std::endl;
+    std::cerr << "Usage: " << prg << " [-d] [-h] [-a] [-t N] [-D [-T DIR] [-M MB]] [-x FILE] [-c FILE [-i MIN] [-r]] OSMFILE" << std::endl;
+    std::cerr << "  -a, --approx          estimate the number of different post codes per" << std::endl;
+    std::cerr << "                        addr:country (HyperLogLog) instead of storing them" << std::endl;
+    std::cerr << "  -t, --threads N       process the data with N worker threads" << std::endl;
+    std::cerr << "  -D, --duplicates      report addresses (street, house number, post code," << std::endl;
+    std::cerr << "                        city) that occur on more than one object" << std::endl;
+    std::cerr << "  -T, --tmpdir DIR      directory for the temporary files of --duplicates" << std::endl;
+    std::cerr << "                        (default: $TMPDIR or /tmp)" << std::endl;
+    std::cerr << "  -M, --sort-memory MB  memory used for sorting by --duplicates (default: 1024)" << std::endl;
+    std::cerr << "  -x, --export FILE     write all addresses, including interpolated house" << std::endl;
+    std::cerr << "                        numbers, with their location to FILE (see" << std::endl;
+    std::cerr << "                        address_export.hpp for the format)" << std::endl;
+    std::cerr << "  -c, --checkpoint FILE save the state to FILE from time to time (PBF input" << std::endl;
+    std::cerr << "                        only, not with -D and -x); FILE is removed when the" << std::endl;
+    std::cerr << "                        run completes" << std::endl;
+    std::cerr << "  -i, --checkpoint-interval MIN" << std::endl;
+    std::cerr << "                        minutes between checkpoints (default: 10)" << std::endl;
+    std::cerr << "  -r, --resume          continue an interrupted run from the checkpoint FILE" << std::endl;
 
 }
 
 int main(int argc, char* argv[])
 {
     static struct option long_options[] = {
+        {"approx", no_argument, 0, 'a'},
+        {"checkpoint", required_argument, 0, 'c'},
+        {"checkpoint-interval", required_argument, 0, 'i'},
         {"debug",  no_argument, 0, 'd'},
+        {"duplicates", no_argument, 0, 'D'},
+        {"export", required_argument, 0, 'x'},
         {"help",   no_argument, 0, 'h'},
+        {"resume", no_argument, 0, 'r'},
+        {"sort-memory", required_argument, 0, 'M'},
+        {"threads", required_argument, 0, 't'},
+        {"tmpdir", required_argument, 0, 'T'},
         {0, 0, 0, 0}
     };
 
     bool debug = false;
+    bool approx = false;
+    size_t threads = 1;
+    bool find_duplicates = false;
+    std::string tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    size_t sort_memory = 1024;
+    std::string export_file;
+    std::string checkpoint_file;
+    unsigned int checkpoint_interval = 10;
+    bool resume = false;
 
     while (true) 
     {
-        int c = getopt_long(argc, argv, "dh", long_options, 0);
+        int c = getopt_long(argc, argv, "ac:dDhi:M:rt:T:x:", long_options, 0);
         if (c == -1) break;
 
         switch (c) 
         {
+            case 'a':
+                approx = true;
+                break;
+            case 'c':
+                checkpoint_file = optarg;
+                break;
+            case 'i':
+                checkpoint_interval = positive_option(optarg, "checkpoint-interval", 100000);
+                break;
+            case 'r':
+                resume = true;
+                break;
             case 'd':
                 debug = true;
                 break;
+            case 'D':
+                find_duplicates = true;
+                break;
+            case 'M':
+                sort_memory = positive_option(optarg, "sort-memory", 1024 * 1024);
+                break;
+            case 'T':
+                tmpdir = optarg;
+                break;
+            case 'x':
+                export_file = optarg;
+                break;
             case 'h':
                 usage(argv[0]);
                 exit(0);
+            case 't':
+                threads = positive_option(optarg, "threads", 1024);
+                break;
             default:
                 exit(1);
         }
@@ -248,11 +142,134 @@ int main(int argc, char* argv[])
 
 
     osmium::io::File infile(input);
-    osmium::io::Reader reader(infile);
+    InputFile input_file(infile);
+
+    if (resume && checkpoint_file.empty())
+    {
+        std::cerr << "--resume requires --checkpoint" << std::endl;
+        exit(1);
+    }
+    if (!checkpoint_file.empty() && (find_duplicates || !export_file.empty()))
+    {
+        std::cerr << "--checkpoint cannot be combined with --duplicates or --export" << std::endl;
+        exit(1);
+    }
+    if (!checkpoint_file.empty() && infile.format() != osmium::io::file_format::pbf)
+    {
+        std::cerr << "--checkpoint requires PBF input" << std::endl;
+        exit(1);
+    }
+
+    HousenumberStore housenumbers;
+    std::unique_ptr<LocationStore> locations;
+    std::unique_ptr<AddressExport> exporter;
+    if (!export_file.empty())
+    {
+        housenumbers.enable_strings();
+        locations.reset(new LocationStore);
+        exporter.reset(new AddressExport(export_file));
+    }
+
+    // every worker thread counts into a handler of its own, these are
+    // merged at the end
+    std::vector<AddressCountHandler> handlers;
+    for (size_t i = 0; i < threads; i++)
+    {
+        handlers.emplace_back(debug, approx, housenumbers);
+        if (find_duplicates) handlers.back().enable_duplicates(sort_memory * 1024 * 1024 / threads, tmpdir);
+        if (exporter) handlers.back().enable_export(exporter.get(), locations.get());
+    }
+
+    // with --checkpoint the input is read in chunks of PBF blocks and
+    // the state is saved between two chunks
+    std::unique_ptr<PbfBlockReader> blocks;
+    CheckpointInfo info;
+    if (!checkpoint_file.empty())
+    {
+        blocks.reset(new PbfBlockReader(input));
+        info.program = "count_addresses";
+        info.settings = std::string(approx ? "approx " : "") + "threads=" + std::to_string(threads);
+        info.input_size = blocks->size();
+    }
+
+    if (resume)
+    {
+        CheckpointReader in(checkpoint_file);
+        CheckpointInfo saved;
+        saved.checkpoint(in);
+        if (!saved.compatible(info))
+        {
+            std::cerr << checkpoint_file << " was written for another input file or with other options (" << saved.settings << ")" << std::endl;
+            exit(1);
+        }
+        housenumbers.checkpoint(in);
+        for (AddressCountHandler& h : handlers) h.checkpoint(in);
+        blocks->seek(saved.offset);
+    }
+    else
+    {
+        // first pass: find the nodes of all interpolation ways (and, for
+        // --export, of all address ways)
+        InterpolationNodeHandler interpolation_node_handler(housenumbers, locations.get());
+        osmium::io::Reader reader1(input_file.open(), osmium::osm_entity_bits::way);
+        osmium::apply(reader1, interpolation_node_handler);
+        reader1.close();
+        input_file.close();
+        housenumbers.prepare();
+        if (locations) locations->prepare();
+    }
+
+    auto count = [&](osmium::io::Reader& reader) {
+        if (threads == 1)
+        {
+            osmium::apply(reader, handlers[0]);
+        }
+        else
+        {
+            // way centroids for --export need all node locations
+            parallel_apply(reader, threads, [&handlers](size_t i, osmium::memory::Buffer& buffer) {
+                osmium::apply(buffer, handlers[i]);
+            }, exporter != nullptr);
+        }
+    };
+
+    if (!blocks)
+    {
+        osmium::io::Reader reader(input_file.open());
+        count(reader);
+        reader.close();
+        input_file.close();
+    }
+    else
+    {
+        CheckpointTimer timer(checkpoint_interval);
+        std::string chunk;
+        while (blocks->next_chunk(chunk))
+        {
+            osmium::io::Reader reader(osmium::io::File(chunk.data(), chunk.size(), "pbf"));
+            count(reader);
+            reader.close();
+            if (!timer.due()) continue;
+            CheckpointWriter out(checkpoint_file);
+            info.offset = blocks->offset();
+            info.checkpoint(out);
+            housenumbers.checkpoint(out);
+            for (AddressCountHandler& h : handlers) h.checkpoint(out);
+            out.commit();
+            if (debug) std::cerr << "checkpoint at offset " << info.offset << std::endl;
+        }
+    }
+
+    for (AddressCountHandler& h : handlers) h.resolve_interpolations();
+    for (size_t i = 1; i < threads; i++) handlers[0].merge(handlers[i]);
+    handlers[0].print();
+
+    if (exporter)
+    {
+        exporter->close();
+        std::cout << "\naddresses exported: " << exporter->size() << std::endl;
+    }
 
-    AddressCountHandler handler(debug);
-    osmium::apply(reader, handler);
-    reader.close();
-    handler.print();
+    if (!checkpoint_file.empty()) unlink(checkpoint_file.c_str());
 }
 
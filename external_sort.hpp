@@ -0,0 +1,261 @@
+#ifndef EXTERNAL_SORT_HPP
+#define EXTERNAL_SORT_HPP
+
+/*
+  Bounded-memory external merge sort for fixed-size records. Records
+  are collected in memory; whenever the memory budget is used up they
+  are sorted and appended to an anonymous temporary file as a "run".
+  merge() streams all runs back in sorted order using a k-way merge of
+  at most max_merge_runs runs at a time; with more runs, groups of runs
+  are first merged into longer runs in a second temporary file, as
+  often as needed. The read buffers of the merge share the memory
+  budget, so neither memory nor file descriptors grow with the number
+  of runs.
+
+  Several sorters (e.g. one per worker thread, each sorting its own
+  runs in parallel) can be combined with take_runs() before merging.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+template <typename T>
+class ExternalSorter
+{
+
+private:
+    static const size_t max_merge_runs = 64;
+
+    // a sorted run: records [begin, end) of a temporary file
+    struct Run
+    {
+        int fd;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    size_t max_records;
+    std::string directory;
+    std::vector<T> records;
+    std::vector<Run> runs;
+
+    // the temporary files holding the runs, fd is the one spill()
+    // appends to (-1 before the first spill)
+    std::vector<int> files;
+    int fd = -1;
+    uint64_t fd_records = 0;
+
+    int create_run_file()
+    {
+        std::string name = directory + "/osmium-sort-XXXXXX";
+        int f = mkstemp(&name[0]);
+        if (f < 0) throw std::runtime_error("can not create temporary file in " + directory + ": " + strerror(errno));
+        // the file disappears as soon as it is closed
+        unlink(name.c_str());
+        files.push_back(f);
+        return f;
+    }
+
+    // writes the records to the file at record offset pos
+    static void write_records(int f, const T* data, size_t count, uint64_t pos)
+    {
+        const char* p = reinterpret_cast<const char*>(data);
+        size_t size = count * sizeof(T);
+        off_t offset = pos * sizeof(T);
+        while (size)
+        {
+            ssize_t n = pwrite(f, p, size, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error(std::string("error writing temporary file: ") + strerror(errno));
+            p += n;
+            size -= n;
+            offset += n;
+        }
+    }
+
+    // one sorted run being read back during the merge
+    struct RunReader
+    {
+        Run run;
+        std::vector<T> buffer;
+        size_t capacity;
+        size_t pos = 0;
+
+        RunReader(const Run& run, size_t capacity) : run(run), capacity(capacity) {
+        }
+
+        bool fill()
+        {
+            size_t n = std::min<uint64_t>(capacity, run.end - run.begin);
+            buffer.resize(n);
+            char* p = reinterpret_cast<char*>(buffer.data());
+            size_t size = n * sizeof(T);
+            off_t offset = run.begin * sizeof(T);
+            while (size)
+            {
+                ssize_t r = pread(run.fd, p, size, offset);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) throw std::runtime_error("error reading temporary file");
+                p += r;
+                size -= r;
+                offset += r;
+            }
+            run.begin += n;
+            pos = 0;
+            return n > 0;
+        }
+
+        const T& current() const
+        {
+            return buffer[pos];
+        }
+
+        bool next()
+        {
+            if (++pos < buffer.size()) return true;
+            return fill();
+        }
+    };
+
+    // k-way merge of the runs, each read with a buffer of buffer_records
+    template <typename TFunc>
+    static void merge_runs(const Run* first, const Run* last, size_t buffer_records, TFunc func)
+    {
+        std::vector<RunReader> readers;
+        readers.reserve(last - first);
+        for (const Run* r = first; r != last; r++) readers.emplace_back(*r, buffer_records);
+
+        auto greater = [&readers](size_t a, size_t b) {
+            return readers[b].current() < readers[a].current();
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+        for (size_t i = 0; i < readers.size(); i++)
+        {
+            if (readers[i].fill()) heap.push(i);
+        }
+
+        while (!heap.empty())
+        {
+            size_t i = heap.top();
+            heap.pop();
+            func(readers[i].current());
+            if (readers[i].next()) heap.push(i);
+        }
+    }
+
+    // merges groups of max_merge_runs runs into one run each, written to
+    // a new temporary file, and closes the files of the old runs
+    void merge_pass()
+    {
+        // max_merge_runs read buffers plus one write buffer
+        size_t buffer_records = std::max(max_records / (max_merge_runs + 1), size_t(1));
+        std::vector<int> old_files;
+        old_files.swap(files);
+        int out = create_run_file();
+        uint64_t out_records = 0;
+        std::vector<Run> merged;
+        std::vector<T> buffer;
+        buffer.reserve(buffer_records);
+
+        for (size_t i = 0; i < runs.size(); i += max_merge_runs)
+        {
+            size_t last = std::min(i + max_merge_runs, runs.size());
+            Run run{out, out_records, out_records};
+            merge_runs(&runs[i], &runs[0] + last, buffer_records, [&](const T& record) {
+                buffer.push_back(record);
+                if (buffer.size() < buffer_records) return;
+                write_records(out, buffer.data(), buffer.size(), run.end);
+                run.end += buffer.size();
+                buffer.clear();
+            });
+            write_records(out, buffer.data(), buffer.size(), run.end);
+            run.end += buffer.size();
+            buffer.clear();
+            out_records = run.end;
+            merged.push_back(run);
+        }
+
+        for (int f : old_files) close(f);
+        runs.swap(merged);
+    }
+
+public:
+
+    ExternalSorter(size_t memory, const std::string& directory) :
+        max_records(std::max(memory / sizeof(T), size_t(1024))),
+        directory(directory) {
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    ~ExternalSorter()
+    {
+        for (int f : files) close(f);
+    }
+
+    void add(const T& record)
+    {
+        // allocated once, so the buffer never exceeds the budget
+        if (records.capacity() < max_records) records.reserve(max_records);
+        records.push_back(record);
+        if (records.size() >= max_records) spill();
+    }
+
+    // sorts the records held in memory and writes them out as a run
+    void spill()
+    {
+        if (records.empty()) return;
+        std::sort(records.begin(), records.end());
+        if (fd < 0) fd = create_run_file();
+        write_records(fd, records.data(), records.size(), fd_records);
+        runs.push_back(Run{fd, fd_records, fd_records + records.size()});
+        fd_records += records.size();
+        records.clear();
+    }
+
+    // Moves all data of the other sorter into this one. Its memory
+    // budget is no longer needed by the other sorter and is added to
+    // the budget of the merge.
+    void take_runs(ExternalSorter& other)
+    {
+        other.spill();
+        std::vector<T>().swap(other.records);
+        runs.insert(runs.end(), other.runs.begin(), other.runs.end());
+        files.insert(files.end(), other.files.begin(), other.files.end());
+        max_records += other.max_records;
+        other.runs.clear();
+        other.files.clear();
+        other.fd = -1;
+    }
+
+    // calls func(const T&) for all records in sorted order
+    template <typename TFunc>
+    void merge(TFunc func)
+    {
+        spill();
+        std::vector<T>().swap(records);
+        fd = -1;
+
+        while (runs.size() > max_merge_runs) merge_pass();
+        if (runs.empty()) return;
+        merge_runs(&runs[0], &runs[0] + runs.size(), std::max(max_records / runs.size(), size_t(1)), func);
+    }
+
+};
+
+#endif // EXTERNAL_SORT_HPP
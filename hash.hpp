@@ -0,0 +1,61 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+/*
+  64 bit string hash (MurmurHash64A by Austin Appleby) used by the
+  hash sets and sketches of the osmium-based utilities.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+
+inline uint64_t hash_bytes(const char* data, size_t length, uint64_t seed = 0)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = seed ^ (length * m);
+
+    const char* end = data + (length & ~size_t(7));
+    for (const char* p = data; p != end; p += 8)
+    {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = reinterpret_cast<const unsigned char*>(end);
+    switch (length & 7)
+    {
+        case 7: h ^= uint64_t(tail[6]) << 48; // fall through
+        case 6: h ^= uint64_t(tail[5]) << 40; // fall through
+        case 5: h ^= uint64_t(tail[4]) << 32; // fall through
+        case 4: h ^= uint64_t(tail[3]) << 24; // fall through
+        case 3: h ^= uint64_t(tail[2]) << 16; // fall through
+        case 2: h ^= uint64_t(tail[1]) << 8;  // fall through
+        case 1: h ^= uint64_t(tail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+inline uint64_t hash_string(const char* s, uint64_t seed = 0)
+{
+    return hash_bytes(s, strlen(s), seed);
+}
+
+#endif // HASH_HPP
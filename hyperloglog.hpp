@@ -0,0 +1,78 @@
+#ifndef HYPERLOGLOG_HPP
+#define HYPERLOGLOG_HPP
+
+/*
+  HyperLogLog sketch for estimating the number of distinct values
+  in constant memory (2^precision bytes). Values are added as 64 bit
+  hashes, see hash.hpp. Two sketches of the same precision can be
+  merged.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+class HyperLogLog
+{
+
+private:
+    unsigned int precision;
+    std::vector<uint8_t> registers;
+
+public:
+
+    HyperLogLog(unsigned int precision = 14) : precision(precision), registers(size_t(1) << precision, 0) {
+    }
+
+    void add(uint64_t hash)
+    {
+        size_t index = hash >> (64 - precision);
+        // the guard bit limits the rank to 64 - precision + 1
+        uint64_t rest = (hash << precision) | (uint64_t(1) << (precision - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        if (rank > registers[index]) registers[index] = rank;
+    }
+
+    void merge(const HyperLogLog& other)
+    {
+        for (size_t i = 0; i < registers.size(); i++)
+        {
+            registers[i] = std::max(registers[i], other.registers[i]);
+        }
+    }
+
+    double estimate() const
+    {
+        double m = registers.size();
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers)
+        {
+            sum += std::ldexp(1.0, -r);
+            if (!r) zeros++;
+        }
+        double alpha = 0.7213 / (1 + 1.079 / m);
+        double e = alpha * m * m / sum;
+        // small range correction (linear counting)
+        if (e <= 2.5 * m && zeros) e = m * std::log(m / zeros);
+        return e;
+    }
+
+    // see checkpoint.hpp
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        archive.field(precision);
+        archive.field(registers);
+    }
+
+};
+
+#endif // HYPERLOGLOG_HPP
@@ -0,0 +1,114 @@
+#ifndef NODE_REF_COUNTER_HPP
+#define NODE_REF_COUNTER_HPP
+
+/*
+  A small count per node id (such as the degree of the node in the road
+  network), saturating at 3, in a dense array of 2 bit counters indexed
+  by node id (a quarter of a byte per possible id: the planet's ids up
+  to about 1.3e10 need some 3 GB, the default limit of 2^34 ids reserves
+  4 GB). The array is reserved as virtual memory up to max_id; only the
+  parts of the id range that are used take up memory. With a directory, the array lives in an
+  (unlinked) temporary file there instead of in anonymous memory, so
+  the kernel can write it out under memory pressure without swap.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <osmium/osm/types.hpp>
+
+class NodeRefCounter
+{
+
+private:
+    uint64_t max_id;
+    size_t bytes;
+    uint8_t *data;
+    // bytes [0, used) may contain counters
+    size_t used = 0;
+
+public:
+
+    static const uint64_t default_max_id = uint64_t(1) << 34;
+
+    explicit NodeRefCounter(const std::string& directory = "", uint64_t max_id = default_max_id) :
+        max_id(max_id),
+        bytes(max_id / 4)
+    {
+        int fd = -1;
+        if (!directory.empty())
+        {
+            std::string name = directory + "/osmium-noderefs-XXXXXX";
+            fd = mkstemp(&name[0]);
+            if (fd < 0) throw std::runtime_error("can not create temporary file in " + directory + ": " + strerror(errno));
+            unlink(name.c_str());
+            if (ftruncate(fd, bytes))
+            {
+                close(fd);
+                throw std::runtime_error(std::string("can not resize temporary file: ") + strerror(errno));
+            }
+        }
+        void *p = (fd < 0)
+            ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)
+            : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (fd >= 0) close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error(std::string("can not map node reference counters: ") + strerror(errno));
+        data = static_cast<uint8_t *>(p);
+    }
+
+    ~NodeRefCounter()
+    {
+        munmap(data, bytes);
+    }
+
+    NodeRefCounter(const NodeRefCounter&) = delete;
+    NodeRefCounter& operator=(const NodeRefCounter&) = delete;
+
+    // adds n to the count of the id, saturating at 3
+    void add(osmium::unsigned_object_id_type id, unsigned int n = 1)
+    {
+        if (id >= max_id) throw std::runtime_error("node id " + std::to_string(id) + " too large for the node reference counters");
+        uint8_t& byte = data[id >> 2];
+        unsigned int shift = (id & 3) * 2;
+        unsigned int count = std::min(((byte >> shift) & 3u) + n, 3u);
+        byte = (byte & ~(3u << shift)) | (count << shift);
+        if ((id >> 2) >= used) used = (id >> 2) + 1;
+    }
+
+    // 0, 1, 2 or 3 (for 3 or more)
+    unsigned int get(osmium::unsigned_object_id_type id) const
+    {
+        if (id >= max_id) return 0;
+        return (data[id >> 2] >> ((id & 3) * 2)) & 3;
+    }
+
+    // number of ids with a count of at least n (1..3)
+    uint64_t count_at_least(unsigned int n) const
+    {
+        uint8_t table[256];
+        for (unsigned int b = 0; b < 256; b++)
+        {
+            table[b] = 0;
+            for (unsigned int shift = 0; shift < 8; shift += 2) table[b] += ((b >> shift) & 3) >= n;
+        }
+        uint64_t count = 0;
+        for (size_t i = 0; i < used; i++) count += table[data[i]];
+        return count;
+    }
+
+};
+
+#endif // NODE_REF_COUNTER_HPP
@@ -0,0 +1,33 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+/*
+  Command line helpers shared by the tools.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+
+// Parses the argument of a numeric option, exits with an error message
+// unless it is a whole number between 1 and max.
+inline long positive_option(const char *arg, const char *option, long max)
+{
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end || errno || value < 1 || value > max)
+    {
+        std::cerr << "--" << option << " requires a positive number up to " << max << std::endl;
+        exit(1);
+    }
+    return value;
+}
+
+#endif // OPTIONS_HPP
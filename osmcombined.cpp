@@ -0,0 +1,359 @@
+/*
+  osmium-based tool that runs the handlers of osmstats, count_addresses
+  and osmgrep on a single read of the input file. Every selected stage
+  prints its results in the format of the original tool.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <iostream>
+
+#define OSMIUM_WITH_PBF_INPUT
+#define OSMIUM_WITH_XML_INPUT
+
+#include <getopt.h>
+
+#include <osmium/area/assembler.hpp>
+#include <osmium/area/multipolygon_collector.hpp>
+#include <osmium/handler.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/io/any_output.hpp>
+#include <osmium/io/output_iterator.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/visitor.hpp>
+
+#include <memory>
+
+#include "address_count_handler.hpp"
+#include "osmgrep_filter.hpp"
+#include "parallel_apply.hpp"
+#include "parallel_input.hpp"
+#include "statistics_handler.hpp"
+
+/* ================================================== */
+
+/*
+  osmgrep as a handler: counts the matching objects, or writes them to
+  the output file if one is given.
+*/
+class GrepHandler : public osmium::handler::Handler
+{
+
+private:
+    GrepFilter& filter;
+    std::unique_ptr<osmium::io::Writer> writer;
+    std::unique_ptr<osmium::io::OutputIterator<osmium::io::Writer>> output;
+    uint64_t node_count = 0;
+    uint64_t way_count = 0;
+    uint64_t relation_count = 0;
+
+    void object(const osmium::OSMObject& object)
+    {
+        if (!filter.match(object)) return;
+        if (output)
+        {
+            **output = object;
+            ++*output;
+            return;
+        }
+        switch (object.type())
+        {
+            case osmium::item_type::node:
+                node_count++;
+                break;
+            case osmium::item_type::way:
+                way_count++;
+                break;
+            case osmium::item_type::relation:
+                relation_count++;
+                break;
+            default:
+                break;
+        }
+    }
+
+public:
+
+    GrepHandler(GrepFilter& filter, const char *output_file, osmium::io::Header header) : filter(filter)
+    {
+        if (output_file)
+        {
+            header.set("generator", "osmgrep");
+            writer.reset(new osmium::io::Writer(osmium::io::File(output_file), header, osmium::io::overwrite::allow));
+            output.reset(new osmium::io::OutputIterator<osmium::io::Writer>(*writer));
+        }
+    }
+
+    void node(const osmium::Node& node)
+    {
+        object(node);
+    }
+
+    void way(const osmium::Way& way)
+    {
+        object(way);
+    }
+
+    void relation(const osmium::Relation& relation)
+    {
+        object(relation);
+    }
+
+    void close()
+    {
+        output.reset();
+        if (writer) writer->close();
+    }
+
+    void print()
+    {
+        if (writer) return;
+        std::cout << std::endl;
+        std::cout << " #nodes matching      = " << node_count << std::endl;
+        std::cout << " #ways matching       = " << way_count << std::endl;
+        std::cout << " #relations matching  = " << relation_count << std::endl;
+    }
+
+};
+
+/* ================================================== */
+
+void usage(const char *prg)
+{
+    std::cerr << "Usage: " << prg << " [OPTIONS] OSMFILE" << std::endl;
+    std::cerr << "Runs several of the tools on one read of OSMFILE." << std::endl;
+    std::cerr << "  -s, --stats              osmstats" << std::endl;
+    std::cerr << "  -a, --addresses          count_addresses" << std::endl;
+    std::cerr << "      --approx             ... with count_addresses --approx" << std::endl;
+    std::cerr << "      --grep-type <t>      osmgrep with the given selectors, see osmgrep --help" << std::endl;
+    std::cerr << "      --grep-oid <i>" << std::endl;
+    std::cerr << "      --grep-uid <i>" << std::endl;
+    std::cerr << "      --grep-version <i>" << std::endl;
+    std::cerr << "      --grep-user <u>" << std::endl;
+    std::cerr << "      --grep-expr <e>" << std::endl;
+    std::cerr << "      --grep-output <o>    write the objects matching the osmgrep selectors" << std::endl;
+    std::cerr << "      --grep               osmgrep without selectors (matches everything)" << std::endl;
+    std::cerr << "Only the base counts of osmstats and count_addresses are available: run the" << std::endl;
+    std::cerr << "tools themselves for count_addresses --threads, --duplicates, --export and" << std::endl;
+    std::cerr << "--debug, and for osmstats --checkpoint, --sample, --junctions and --by-user." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    static struct option long_options[] = {
+        {"addresses",    no_argument,       0, 'a'},
+        {"approx",       no_argument,       0, 'A'},
+        {"grep",         no_argument,       0, 'g'},
+        {"grep-expr",    required_argument, 0, 'e'},
+        {"grep-oid",     required_argument, 0, 'd'},
+        {"grep-output",  required_argument, 0, 'o'},
+        {"grep-type",    required_argument, 0, 't'},
+        {"grep-uid",     required_argument, 0, 'i'},
+        {"grep-user",    required_argument, 0, 'u'},
+        {"grep-version", required_argument, 0, 'v'},
+        {"help",         no_argument,       0, 'h'},
+        {"stats",        no_argument,       0, 's'},
+        {0, 0, 0, 0}
+    };
+
+    bool stats = false;
+    bool addresses = false;
+    bool approx = false;
+    bool grep = false;
+    GrepFilter filter;
+    const char *grep_output = nullptr;
+
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "ahs", long_options, 0);
+        if (c == -1) break;
+
+        switch (c)
+        {
+            case 'a':
+                addresses = true;
+                break;
+            case 'A':
+                approx = true;
+                break;
+            case 's':
+                stats = true;
+                break;
+            case 'g':
+                grep = true;
+                break;
+            case 'e':
+                grep = true;
+                if (!filter.tag_filter.add(optarg))
+                {
+                    std::cerr << "--grep-expr requires key=value, key~text or key>number style argument" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'd':
+                grep = true;
+                filter.object_id = strtol(optarg, NULL, 0);
+                break;
+            case 'o':
+                grep = true;
+                grep_output = optarg;
+                break;
+            case 't':
+                grep = true;
+                if (!filter.add_type(optarg))
+                {
+                    std::cerr << "--grep-type requires node, way or relation" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'i':
+                grep = true;
+                filter.user_id = strtol(optarg, NULL, 0);
+                break;
+            case 'u':
+                grep = true;
+                filter.user_name = optarg;
+                break;
+            case 'v':
+                grep = true;
+                filter.version = strtol(optarg, NULL, 0);
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            default:
+                exit(1);
+        }
+    }
+
+    if (argc - optind != 1 || !(stats || addresses || grep))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    filter.compile();
+
+    osmium::io::File infile(argv[optind]);
+    InputFile input_file(infile);
+
+    // The pre-pass reads only ways and relations and serves both the
+    // multipolygon collector of osmstats and the interpolation node
+    // collection of count_addresses. It can not be folded into the main
+    // pass: both need to know the relations and ways before the nodes,
+    // which come first in the file.
+    osmium::area::Assembler::config_type assembler_config;
+    osmium::area::MultipolygonCollector<osmium::area::Assembler> collector{assembler_config};
+    HousenumberStore housenumbers;
+
+    osmium::osm_entity_bits::type prepass_types = osmium::osm_entity_bits::nothing;
+    if (stats) prepass_types |= osmium::osm_entity_bits::relation;
+    if (addresses) prepass_types |= osmium::osm_entity_bits::way;
+
+    if (prepass_types != osmium::osm_entity_bits::nothing)
+    {
+        InterpolationNodeHandler interpolation_node_handler(housenumbers, nullptr);
+
+        // relations the collector is interested in are copied into one
+        // buffer and handed over at the end
+        osmium::memory::Buffer relations(1024 * 1024, osmium::memory::Buffer::auto_grow::yes);
+
+        osmium::io::Reader reader1(input_file.open(), prepass_types);
+        while (osmium::memory::Buffer buffer = reader1.read())
+        {
+            if (addresses) osmium::apply(buffer, interpolation_node_handler);
+            if (stats)
+            {
+                for (auto it = buffer.begin<osmium::Relation>(); it != buffer.end<osmium::Relation>(); ++it)
+                {
+                    const char *type = it->tags().get_value_by_key("type");
+                    if (type && (!strcmp(type, "multipolygon") || !strcmp(type, "boundary")))
+                    {
+                        relations.add_item(*it);
+                        relations.commit();
+                    }
+                }
+            }
+        }
+        reader1.close();
+        input_file.close();
+
+        if (stats) collector.read_relations(relations.begin(), relations.end());
+        housenumbers.prepare();
+    }
+
+    // The main pass decodes the file once and hands every buffer to all
+    // selected stages, each running in a thread of its own.
+    osmium::io::Reader reader(input_file.open());
+
+    StatisticsHandler stat_handler;
+    index_type index;
+    location_handler_type location_handler{index};
+    location_handler.ignore_errors();
+    auto area_handler = collector.handler([&stat_handler](osmium::memory::Buffer&& buffer) {
+        osmium::apply(buffer, stat_handler);
+    });
+
+    std::unique_ptr<AddressCountHandler> address_handler;
+    if (addresses) address_handler.reset(new AddressCountHandler(false, approx, housenumbers));
+
+    std::unique_ptr<GrepHandler> grep_handler;
+    if (grep) grep_handler.reset(new GrepHandler(filter, grep_output, reader.header()));
+
+    bool several = (stats + addresses + grep) > 1;
+
+    std::vector<std::function<void(osmium::memory::Buffer&)>> stages;
+    if (stats)
+    {
+        stages.push_back([&](osmium::memory::Buffer& buffer) {
+            if (!several)
+            {
+                osmium::apply(buffer, location_handler, stat_handler, area_handler);
+                return;
+            }
+            // the location handler adds the node locations to the ways,
+            // so it gets a copy of the buffer shared with the other stages
+            osmium::memory::Buffer copy(buffer.committed());
+            copy.add_buffer(buffer);
+            copy.commit();
+            osmium::apply(copy, location_handler, stat_handler, area_handler);
+        });
+    }
+    if (addresses)
+    {
+        stages.push_back([&](osmium::memory::Buffer& buffer) {
+            osmium::apply(buffer, *address_handler);
+        });
+    }
+    if (grep)
+    {
+        stages.push_back([&](osmium::memory::Buffer& buffer) {
+            osmium::apply(buffer, *grep_handler);
+        });
+    }
+    pipeline_apply(reader, stages);
+    reader.close();
+    input_file.close();
+
+    if (grep) grep_handler->close();
+
+    if (stats)
+    {
+        if (several) std::cout << "==> osmstats <==" << std::endl;
+        stat_handler.print();
+    }
+    if (addresses)
+    {
+        if (several) std::cout << (stats ? "\n" : "") << "==> count_addresses <==" << std::endl;
+        address_handler->resolve_interpolations();
+        address_handler->print();
+    }
+    if (grep)
+    {
+        if (several) std::cout << "\n==> osmgrep <==" << std::endl;
+        grep_handler->print();
+    }
+}
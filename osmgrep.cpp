@@ -17,6 +17,9 @@
 #include <getopt.h>
 #include <vector>
 #include <algorithm> // for std::copy_if
+#include <cstdlib>
+#include <cstring>
+#include <osmium/osm/tag.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/any_output.hpp>
 #include <osmium/handler.hpp>
@@ -30,6 +33,9 @@
 #include <osmium/io/input_iterator.hpp>
 #include <osmium/io/output_iterator.hpp>
 
+#include "osmgrep_filter.hpp"
+#include "parallel_input.hpp"
+
 void print_help(const char *progname)
 {
     std::cerr << "\n" << progname << " [OPTIONS] <inputfile> \n"
@@ -41,7 +47,14 @@ void print_help(const char *progname)
             << "  --uid <i>       match user ID i\n"
             << "  --version <i>   match verison i (+i = larger than i, -i = smaller than i)\n"
             << "  --user <u>      match user name u\n"
-            << "  --expr <e>      match objects with given tag (e can be type=value or type=*)\n"
+            << "  --expr <e>      match objects with given tag, e can be one of\n"
+            << "                    key=value   exact value\n"
+            << "                    key=*       any value\n"
+            << "                    key~text    value contains text; use ^text for a\n"
+            << "                                prefix, text$ for a suffix, ^text$ for exact\n"
+            << "                    key>n, key>=n, key<n, key<=n\n"
+            << "                                numeric comparison (e.g. maxspeed>100); values\n"
+            << "                                that are not just a number (\"100 mph\") never match\n"
             << "  --output <o>    write output to file o (without, just displays counts)\n"
             << "  --progress <p>  shows progress bar\n"
             << "\nIf multiple selectors are given, objects have to match all conditions.\n"
@@ -50,26 +63,15 @@ void print_help(const char *progname)
             << "only nodes that have at least one of the given tags.\n\n";
 }
 
-
-
 int main(int argc, char* argv[])
 {
     uint64_t node_count = 0;
     uint64_t way_count = 0;
     uint64_t relation_count = 0;
 
-    bool node = false;
-    bool way = false;
-    bool relation = false;
-
     bool enable_progress_bar = false;
 
-    osmium::user_id_type user_id = 0;
-    osmium::object_version_type version = 0;
-    osmium::object_id_type object_id = 0;
-    const char* user_name = nullptr;
-    const char* search_key = nullptr;
-    const char* search_value = nullptr;
+    GrepFilter filter;
     const char* output_file = nullptr;
 
     static struct option long_options[] = {
@@ -93,13 +95,7 @@ int main(int argc, char* argv[])
             print_help(argv[0]);
             exit(0);
         case 't':
-            if (!strcmp(optarg, "node")) {
-                node = true;
-            } else if (!strcmp(optarg, "way")) {
-                way = true;
-            } else if (!strcmp(optarg, "relation")) {
-                relation = true;
-            } else {
+            if (!filter.add_type(optarg)) {
                 std::cerr << "-t flag requires a type node like -tnode for node -tway for way ...\n" << std::endl;
                 print_help(argv[0]);
                 exit(1);
@@ -108,7 +104,7 @@ int main(int argc, char* argv[])
             break;
         case 'i':
             if (optarg) {
-                user_id = strtol(optarg, NULL, 0);
+                filter.user_id = strtol(optarg, NULL, 0);
             } else {
                 std::cerr << "--uid flag requires a number for ID like --uid23232\n" << std::endl;
                 print_help(argv[0]);
@@ -117,7 +113,7 @@ int main(int argc, char* argv[])
             break;
         case 'v':
             if (optarg) {
-                version = strtol(optarg, NULL, 0);
+                filter.version = strtol(optarg, NULL, 0);
             } else {
                 std::cerr << "--version flag requires a number: --version [+-)]5\n" << std::endl;
                 print_help(argv[0]);
@@ -126,7 +122,7 @@ int main(int argc, char* argv[])
             break;
         case 'd':
             if (optarg) {
-                object_id = strtol(optarg, NULL, 0);
+                filter.object_id = strtol(optarg, NULL, 0);
             } else {
                 std::cerr << "--oid flag requires a number for ID like --oid 23232\n" << std::endl;
                 print_help(argv[0]);
@@ -135,7 +131,7 @@ int main(int argc, char* argv[])
             break;
         case 'u':
             if (optarg) {
-                user_name = optarg;
+                filter.user_name = optarg;
             } else {
                 std::cerr << "--user flag requires a string like --user foobar\n" << std::endl;
                 print_help(argv[0]);
@@ -144,16 +140,10 @@ int main(int argc, char* argv[])
             break;
         case 'e':
             if (optarg) {
-                std::string tag(optarg);
-                std::size_t delim = tag.find("=");
-                if (delim != std::string::npos && tag.find("=", delim + 1) != std::string::npos) {
-                    std::cerr << "-e flag requires key=value style argument" << std::endl;
+                if (!filter.tag_filter.add(optarg)) {
+                    std::cerr << "-e flag requires key=value, key~text or key>number style argument" << std::endl;
                     exit(1);
                 }
-                search_key = strdup(tag.substr(0, delim).c_str());
-                if (delim != std::string::npos) {
-                    search_value = strdup(tag.substr(delim + 1).c_str());
-                }
             } else {
                 std::cerr << "-e flag requires key=value style argument" << std::endl;
                 exit(1);
@@ -189,22 +179,20 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
-    // The input file, deduce file format from file suffix
-    osmium::io::File infile{input};
+    filter.compile();
 
+    // The input file, deduce file format from file suffix. bzip2 input
+    // is decompressed in parallel (see parallel_input.hpp).
+    osmium::io::File infile{input};
+    InputFile input_file{infile};
 
-    osmium::osm_entity_bits::type entities = osmium::osm_entity_bits::nothing;
-    if (node)       entities |= osmium::osm_entity_bits::node;
-    if (way)        entities |= osmium::osm_entity_bits::way;
-    if (relation)   entities |= osmium::osm_entity_bits::relation;
 
-    if(entities == osmium::osm_entity_bits::nothing)
-        entities = osmium::osm_entity_bits::all;
+    osmium::osm_entity_bits::type entities = filter.read_types();
 
     // Initialize Reader for the input file.
     // Read only changesets (will ignore nodes, ways, and
     // relations if there are any).
-    osmium::io::Reader reader{infile, entities};
+    osmium::io::Reader reader{input_file.open(), entities};
 
     // Initialize progress bar, enable it only if STDERR is a TTY.
     osmium::ProgressBar progress{reader.file_size(), osmium::util::isatty(2) && enable_progress_bar};
@@ -222,17 +210,7 @@ int main(int argc, char* argv[])
     auto condition = [&](const osmium::OSMObject& object) {
         progress.update(reader.offset());
 
-        if(user_id && object.uid() != user_id) return false;
-        if(version && object.version() != version) return false;
-        if(object_id && object.id() != object_id) return false;
-        if(user_name && strcmp(object.user(), user_name)) return false;
-        if(search_key) {
-            const char* value = object.tags()[search_key];
-            if (!value) return false;
-            if (search_value){
-                if(strcmp(search_value, value) && strcmp(search_value, "*")) return false;
-            }
-        }
+        if(!filter.match(object)) return false;
         if (!output_file){
             switch (object.type()) {
                 case osmium::item_type::node:
@@ -284,5 +262,6 @@ int main(int argc, char* argv[])
     // Progress bar is done.
     progress.done();
     reader.close();
+    input_file.close();
 
 }
@@ -0,0 +1,388 @@
+#ifndef OSMGREP_FILTER_HPP
+#define OSMGREP_FILTER_HPP
+
+/*
+ Object filter of osmgrep, shared by osmgrep and osmcombined.
+ */
+
+/*
+
+ Written 2013 by Dietmar Sauer <Dietmar@geofabrik.de>
+ Ported 2016 to libosmium 2.9 by Philip Beelmann <beelmann@geofabik.de>
+
+ Public Domain.
+
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <osmium/osm.hpp>
+#include <osmium/osm/tag.hpp>
+
+/*
+ Multi-pattern matcher for the string patterns of all --expr options.
+ All patterns are compiled into a single Aho-Corasick automaton with the
+ failure transitions already resolved, so a tag value is scanned exactly
+ once no matter how many patterns the query contains.
+ */
+class PatternAutomaton {
+
+    struct Pattern {
+        std::size_t length;
+        bool anchored_start;
+        bool anchored_end;
+    };
+
+    std::vector<Pattern> m_patterns;
+    std::vector<std::string> m_texts;
+
+    // transition table, 256 entries per state
+    std::vector<uint32_t> m_delta;
+
+    // patterns ending in each state (including those reached through
+    // failure links), state s owns m_outputs[m_output_begin[s]..m_output_begin[s+1])
+    std::vector<uint32_t> m_output_begin;
+    std::vector<uint32_t> m_outputs;
+
+    // pattern i matched the last scanned value if m_stamp[i] == m_generation
+    std::vector<uint32_t> m_stamp;
+    uint32_t m_generation = 0;
+
+public:
+
+    std::size_t add(const std::string& text, bool anchored_start, bool anchored_end) {
+        m_patterns.push_back(Pattern{text.size(), anchored_start, anchored_end});
+        m_texts.push_back(text);
+        return m_patterns.size() - 1;
+    }
+
+    bool empty() const {
+        return m_patterns.empty();
+    }
+
+    void compile() {
+        const uint32_t none = std::numeric_limits<uint32_t>::max();
+
+        // build the trie
+        std::vector<uint32_t> delta(256, none);
+        std::vector<std::vector<uint32_t>> out(1);
+        for (std::size_t id = 0; id < m_texts.size(); ++id) {
+            uint32_t state = 0;
+            for (const char c : m_texts[id]) {
+                const std::size_t edge = state * 256 + static_cast<unsigned char>(c);
+                if (delta[edge] == none) {
+                    delta[edge] = out.size();
+                    out.emplace_back();
+                    delta.resize(delta.size() + 256, none);
+                }
+                state = delta[edge];
+            }
+            out[state].push_back(id);
+        }
+
+        // breadth-first walk computing failure links; missing edges are
+        // replaced by the edge of the failure state so scanning never
+        // has to backtrack
+        std::vector<uint32_t> fail(out.size(), 0);
+        std::vector<uint32_t> queue;
+        for (std::size_t c = 0; c < 256; ++c) {
+            if (delta[c] == none) {
+                delta[c] = 0;
+            } else {
+                queue.push_back(delta[c]);
+            }
+        }
+        for (std::size_t i = 0; i < queue.size(); ++i) {
+            const uint32_t state = queue[i];
+            const std::vector<uint32_t>& inherited = out[fail[state]];
+            out[state].insert(out[state].end(), inherited.begin(), inherited.end());
+            for (std::size_t c = 0; c < 256; ++c) {
+                const uint32_t next = delta[state * 256 + c];
+                const uint32_t fallback = delta[fail[state] * 256 + c];
+                if (next == none) {
+                    delta[state * 256 + c] = fallback;
+                } else {
+                    fail[next] = fallback;
+                    queue.push_back(next);
+                }
+            }
+        }
+
+        m_delta.swap(delta);
+        m_output_begin.clear();
+        m_outputs.clear();
+        for (const auto& o : out) {
+            m_output_begin.push_back(m_outputs.size());
+            m_outputs.insert(m_outputs.end(), o.begin(), o.end());
+        }
+        m_output_begin.push_back(m_outputs.size());
+        m_stamp.assign(m_patterns.size(), 0);
+        m_generation = 0;
+        m_texts.clear();
+    }
+
+    // Runs the automaton over the value, afterwards matched() tells
+    // which patterns occur in it.
+    void scan(const char* value) {
+        if (++m_generation == 0) {
+            std::fill(m_stamp.begin(), m_stamp.end(), 0);
+            m_generation = 1;
+        }
+        uint32_t state = 0;
+        for (std::size_t i = 0; value[i]; ++i) {
+            state = m_delta[state * 256 + static_cast<unsigned char>(value[i])];
+            for (uint32_t o = m_output_begin[state]; o != m_output_begin[state + 1]; ++o) {
+                const uint32_t id = m_outputs[o];
+                const Pattern& p = m_patterns[id];
+                if ((!p.anchored_start || p.length == i + 1) && (!p.anchored_end || !value[i + 1])) {
+                    m_stamp[id] = m_generation;
+                }
+            }
+        }
+    }
+
+    bool matched(std::size_t id) const {
+        return m_stamp[id] == m_generation;
+    }
+
+};
+
+/*
+ The set of --expr conditions. An object matches if any of its tags
+ satisfies any of the conditions. Each tag value is scanned at most once
+ by the pattern automaton and parsed at most once as a number.
+ */
+class TagFilter {
+
+    enum class op {
+        any,
+        equal,
+        contains,
+        less,
+        less_equal,
+        greater,
+        greater_equal
+    };
+
+    struct Expression {
+        op operation;
+        std::string value;
+        double number;
+        std::size_t pattern;
+    };
+
+    struct KeyGroup {
+        std::string key;
+        std::vector<Expression> expressions;
+        bool needs_scan;
+        bool needs_number;
+    };
+
+    std::vector<KeyGroup> m_groups;
+    PatternAutomaton m_automaton;
+
+    // Parses a plain decimal number (optional sign, digits with at most
+    // one '.', optional exponent), surrounded by nothing but whitespace.
+    // Partial values ("100 mph", "5;7") and what else strtod() accepts
+    // ("inf", "nan", "0x10") are not numbers.
+    static bool parse_decimal(const char* value, double& number) {
+        const char* p = value;
+        while (isspace(static_cast<unsigned char>(*p))) ++p;
+        const char* start = p;
+        if (*p == '+' || *p == '-') ++p;
+        std::size_t digits = 0;
+        for (; isdigit(static_cast<unsigned char>(*p)); ++p) ++digits;
+        if (*p == '.') {
+            for (++p; isdigit(static_cast<unsigned char>(*p)); ++p) ++digits;
+        }
+        if (!digits) return false;
+        if (*p == 'e' || *p == 'E') {
+            ++p;
+            if (*p == '+' || *p == '-') ++p;
+            if (!isdigit(static_cast<unsigned char>(*p))) return false;
+            while (isdigit(static_cast<unsigned char>(*p))) ++p;
+        }
+        const char* end = p;
+        while (isspace(static_cast<unsigned char>(*p))) ++p;
+        if (*p) return false;
+        number = strtod(std::string(start, end).c_str(), nullptr);
+        return std::isfinite(number);
+    }
+
+    bool match_group(const KeyGroup& group, const char* value) {
+        if (group.needs_scan) {
+            m_automaton.scan(value);
+        }
+        double number = 0;
+        bool numeric = false;
+        if (group.needs_number) {
+            numeric = parse_decimal(value, number);
+        }
+        for (const Expression& e : group.expressions) {
+            switch (e.operation) {
+                case op::any:
+                    return true;
+                case op::equal:
+                    if (!strcmp(e.value.c_str(), value)) return true;
+                    break;
+                case op::contains:
+                    if (m_automaton.matched(e.pattern)) return true;
+                    break;
+                case op::less:
+                    if (numeric && number < e.number) return true;
+                    break;
+                case op::less_equal:
+                    if (numeric && number <= e.number) return true;
+                    break;
+                case op::greater:
+                    if (numeric && number > e.number) return true;
+                    break;
+                case op::greater_equal:
+                    if (numeric && number >= e.number) return true;
+                    break;
+            }
+        }
+        return false;
+    }
+
+public:
+
+    // Parses an expression like "key=value", "key~^prefix" or "key>=10".
+    // Returns false on syntax errors.
+    bool add(const std::string& expression) {
+        Expression e{op::any, "", 0, 0};
+        std::size_t delim = expression.find_first_of("=~<>");
+        if (delim == 0) return false;
+        if (delim != std::string::npos) {
+            const char c = expression[delim];
+            std::string operand = expression.substr(delim + 1);
+            if (c == '=') {
+                if (operand.find("=") != std::string::npos) return false;
+                if (operand != "*") {
+                    e.operation = op::equal;
+                    e.value = operand;
+                }
+            } else if (c == '~') {
+                const bool anchored_start = !operand.empty() && operand.front() == '^';
+                if (anchored_start) operand.erase(0, 1);
+                const bool anchored_end = !operand.empty() && operand.back() == '$';
+                if (anchored_end) operand.pop_back();
+                if (!operand.empty()) {
+                    e.operation = op::contains;
+                    e.pattern = m_automaton.add(operand, anchored_start, anchored_end);
+                } else if (anchored_start && anchored_end) {
+                    e.operation = op::equal;
+                }
+            } else {
+                const bool or_equal = !operand.empty() && operand.front() == '=';
+                if (or_equal) operand.erase(0, 1);
+                if (!parse_decimal(operand.c_str(), e.number)) return false;
+                if (c == '<') {
+                    e.operation = or_equal ? op::less_equal : op::less;
+                } else {
+                    e.operation = or_equal ? op::greater_equal : op::greater;
+                }
+            }
+        }
+
+        const std::string key = expression.substr(0, delim);
+        auto it = std::find_if(m_groups.begin(), m_groups.end(), [&key](const KeyGroup& g) {
+            return g.key == key;
+        });
+        if (it == m_groups.end()) {
+            m_groups.push_back(KeyGroup{key, {}, false, false});
+            it = m_groups.end() - 1;
+        }
+        it->expressions.push_back(e);
+        if (e.operation == op::contains) it->needs_scan = true;
+        if (e.operation >= op::less) it->needs_number = true;
+        return true;
+    }
+
+    // Must be called once after the last add() and before match().
+    void compile() {
+        std::sort(m_groups.begin(), m_groups.end(), [](const KeyGroup& a, const KeyGroup& b) {
+            return a.key < b.key;
+        });
+        m_automaton.compile();
+    }
+
+    bool empty() const {
+        return m_groups.empty();
+    }
+
+    bool match(const osmium::TagList& tags) {
+        for (const osmium::Tag& tag : tags) {
+            auto it = std::lower_bound(m_groups.begin(), m_groups.end(), tag.key(), [](const KeyGroup& g, const char* key) {
+                return strcmp(g.key.c_str(), key) < 0;
+            });
+            if (it != m_groups.end() && !strcmp(it->key.c_str(), tag.key()) && match_group(*it, tag.value())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+};
+
+/*
+ All conditions given on the osmgrep command line. Fields that are
+ not set (0, nullptr, empty) match everything.
+ */
+class GrepFilter {
+
+public:
+
+    osmium::osm_entity_bits::type entities = osmium::osm_entity_bits::nothing;
+    osmium::user_id_type user_id = 0;
+    osmium::object_version_type version = 0;
+    osmium::object_id_type object_id = 0;
+    const char* user_name = nullptr;
+    TagFilter tag_filter;
+
+    // Adds a type given as "node", "way" or "relation". Returns false
+    // for other values.
+    bool add_type(const char* type) {
+        if (!strcmp(type, "node")) {
+            entities |= osmium::osm_entity_bits::node;
+        } else if (!strcmp(type, "way")) {
+            entities |= osmium::osm_entity_bits::way;
+        } else if (!strcmp(type, "relation")) {
+            entities |= osmium::osm_entity_bits::relation;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // The object types to read, all if no type was given.
+    osmium::osm_entity_bits::type read_types() const {
+        return entities == osmium::osm_entity_bits::nothing ? osmium::osm_entity_bits::all : entities;
+    }
+
+    // Must be called once after the options have been set.
+    void compile() {
+        tag_filter.compile();
+    }
+
+    bool match(const osmium::OSMObject& object) {
+        if(entities != osmium::osm_entity_bits::nothing && !(entities & osmium::osm_entity_bits::from_item_type(object.type()))) return false;
+        if(user_id && object.uid() != user_id) return false;
+        if(version && object.version() != version) return false;
+        if(object_id && object.id() != object_id) return false;
+        if(user_name && strcmp(object.user(), user_name)) return false;
+        if(!tag_filter.empty() && !tag_filter.match(object.tags())) return false;
+        return true;
+    }
+
+};
+
+#endif // OSMGREP_FILTER_HPP
@@ -10,7 +10,16 @@ Handling of areas is still missing.
 
 */
 
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
 
 #define OSMIUM_WITH_PBF_INPUT
 #define OSMIUM_WITH_XML_INPUT
@@ -20,364 +29,428 @@ Handling of areas is still missing.
 #include <osmium/dynamic_handler.hpp>
 
 #include <osmium/handler.hpp>
-#include <osmium/handler/node_locations_for_ways.hpp>
 #include <osmium/index/map/dummy.hpp>
-#include <osmium/index/map/sparse_mem_array.hpp>
 #include <osmium/io/any_input.hpp>
-#include <osmium/geom/haversine.hpp>
 #include <osmium/visitor.hpp>
 
 #include <geos/geom/Geometry.h>
 #include <geos/geom/LineString.h>
 
+#include "block_sample.hpp"
+#include "checkpoint.hpp"
+#include "node_ref_counter.hpp"
+#include "options.hpp"
+#include "parallel_input.hpp"
+#include "pbf_blocks.hpp"
+#include "statistics_handler.hpp"
+#include "user_statistics.hpp"
+
 /* ================================================== */
 
-class StatisticsHandler : public osmium::handler::Handler
+/*
+  Handler for --sample: passes the objects of the sampled blocks to the
+  statistics handler. Node locations are kept in the sampled location
+  store. Areas are not assembled but counted from the tags of closed
+  ways and multipolygon relations.
+*/
+class SampleHandler : public osmium::handler::Handler
 {
 
 private:
-
-    double motorway_trunk_length = 0;
-    double primary_secondary_length = 0;
-    double other_road_length = 0;
-    double residential_road_with_name_length = 0;
-    double residential_road_length = 0;
-    double path_length = 0;
-
-    double river_length = 0;
-    double railway_length = 0;
-    double powerline_length = 0;
-    double water_area = 0;
-    double forest_area = 0;
-
-    int building_count = 0;
-    int housenumber_count = 0;
-    int place_count = 0;
-
-    int poi_power_count = 0;
-    int poi_traffic_count = 0;
-    int poi_other_count = 0;
-    int poi_public_count = 0;
-    int poi_hospitality_count = 0;
-    int poi_shop_count = 0;
-    int poi_religion_count = 0;
-
-    int landuse_green_count = 0;
-    int landuse_blue_count = 0;
-    int landuse_zone_count = 0;
-    int landuse_agri_count = 0;
+    StatisticsHandler& stat_handler;
+    SampledLocations& locations;
 
 public:
 
-    void count_misc(const osmium::TagList& tags)
+    // number of the current block
+    uint32_t block = 0;
+
+    SampleHandler(StatisticsHandler& stat_handler, SampledLocations& locations) : stat_handler(stat_handler), locations(locations) {
+    }
+
+    void node(const osmium::Node& node)
     {
-        const char *t = tags.get_value_by_key("landuse");
-        if (t)
-        {
-            if (!strcmp(t, "forest") || !strcmp(t, "grass") || !strcmp(t, "meadow"))
-            {
-                landuse_green_count++;
-            }
-            else if (!strcmp(t, "residential") || !strcmp(t, "industrial") || !strcmp(t, "commercial") || !strcmp(t, "military"))
-            {
-                landuse_zone_count++;
-            }
-            else if (!strcmp(t, "farmland") || !strcmp(t, "farm") || !strcmp(t, "farmyard"))
-            {
-                landuse_agri_count++;
-            }
-        }
-        t = tags.get_value_by_key("amenity");
-        if (t)
-        {
-            if (!strcmp(t, "restaurant") || !strcmp(t, "cafe") || !strcmp(t, "fast_food") || !strcmp(t, "pub") || !strcmp(t, "bar"))
-            {
-                poi_hospitality_count++;
-            }
-            else if (!strcmp(t, "fuel") || !strcmp(t, "parking"))
-            {
-                poi_traffic_count++;
-            }
-            else if (!strcmp(t, "place_of_worship"))
-            {
-                poi_religion_count++;
-            }
-            else if (!strcmp(t, "school") || !strcmp(t, "public_building") || !strcmp(t, "kindergarten") || !strcmp(t, "hospital") || !strcmp(t, "post_office"))
-            {
-                poi_public_count++;
-            }
-            else if (!strcmp(t, "atm") || !strcmp(t, "bank"))
-            {
-                poi_shop_count++;
-            }
-            else
-            {
-                poi_other_count++;
-            }
-        }
-        if (tags.get_value_by_key("shop"))  poi_shop_count++;
-        t = tags.get_value_by_key("tourism");
-        if (t)
-        {
-            if (!strcmp(t, "hotel") || !strcmp(t, "motel") || !strcmp(t, "camp_site") || !strcmp(t, "hostel"))
-            {
-                poi_hospitality_count++;
-            }
-            else if (!strcmp(t, "museum"))
-            {
-                poi_public_count++;
-            }
-            else
-            {
-                poi_other_count++;
-            }
-        }
-        t = tags.get_value_by_key("highway");
-        if (t)
-        {
-            if (!strcmp(t, "bus_stop"))
-            {
-                poi_traffic_count++;
-            }
-        }
-        t = tags.get_value_by_key("aeroway");
-        if (t)
-        {
-            if (!strcmp(t, "aerodrome"))
-            {
-                poi_traffic_count++;
-            }
-        }
-        t = tags.get_value_by_key("railway");
-        if (t)
-        {
-            if (!strcmp(t, "station") || !strcmp(t, "halt"))
-            {
-                poi_traffic_count++;
-            }
-        }
-        t = tags.get_value_by_key("power");
-        if (t)
-        {
-            if (!strcmp(t, "station") || !strcmp(t, "generator") || !strcmp(t, "transformer"))
-            {
-                poi_power_count++;
-            }
-        }
-        t = tags.get_value_by_key("natural");
-        if (t)
+        locations.add(node.positive_id(), node.location(), block);
+        stat_handler.node(node);
+    }
+
+    void way(const osmium::Way& way)
+    {
+        stat_handler.way(way);
+        if (way.nodes().size() > 3 && way.ends_have_same_id())
         {
-            if (!strcmp(t, "wood"))
-            {
-                landuse_green_count++;
-            }
-            else if (!strcmp(t, "water"))
-            {
-                landuse_blue_count++;
-            }
+            const char *area = way.tags().get_value_by_key("area");
+            if (!area || strcmp(area, "no")) stat_handler.area_tags(way.tags());
         }
     }
 
+    void relation(const osmium::Relation& relation)
+    {
+        const char *type = relation.tags().get_value_by_key("type");
+        if (type && (!strcmp(type, "multipolygon") || !strcmp(type, "boundary"))) stat_handler.area_tags(relation.tags());
+    }
+
+};
 
-    void area(const osmium::Area& area)
+// osmstats --sample: reads about fraction of the blocks and prints the
+// estimated statistics
+void sample_statistics(const char *filename, double fraction, uint64_t seed)
+{
+    PbfBlockReader blocks{filename};
+    StatisticsHandler stat_handler;
+    SampledLocations locations{fraction};
+    stat_handler.set_length_function([&locations](const osmium::Way& way) {
+        return locations.length(way);
+    });
+    SampleHandler handler{stat_handler, locations};
+    BlockSampleEstimator estimator{fraction, stat_handler.metrics().size()};
+
+    uint64_t block_count = 0;
+    uint32_t sampled = 0;
+    std::string chunk;
+    for (;; block_count++)
     {
-        if (area.tags().get_value_by_key("building"))
-        {
-            building_count++;
-        }
-        if (area.tags().get_value_by_key("addr_housenumber"))
+        if (!block_sampled(seed, block_count, fraction))
         {
-            housenumber_count++;
+            if (!blocks.skip_block()) break;
+            continue;
         }
-        count_misc(area.tags());
+        if (!blocks.next_chunk(chunk, 0)) break;
+        std::vector<double> before = stat_handler.metrics();
+        handler.block = sampled++;
+        osmium::io::Reader reader{osmium::io::File(chunk.data(), chunk.size(), "pbf")};
+        osmium::apply(reader, handler);
+        reader.close();
+        estimator.add_block(before, stat_handler.metrics());
     }
 
-    void way(const osmium::Way& way)
+    std::cout << "estimated from " << sampled << " of " << block_count << " blocks (seed " << seed << "), with 95% confidence intervals" << std::endl;
+    for (size_t i = 0; i < stat_handler.metrics().size(); i++)
     {
-        const char *hwy = way.tags().get_value_by_key("highway");
-        if (hwy)
-        {
-            if (!strcmp(hwy, "motorway") || !strcmp(hwy, "trunk"))
-            {
-                motorway_trunk_length += waylen(way);
-            }
-            else if (!strcmp(hwy, "primary") || !strcmp(hwy, "secondary"))
-            {
-                primary_secondary_length += waylen(way);
-            }
-            else if (!strcmp(hwy, "tertiary") || !strcmp(hwy, "unclassified"))
-            {
-                other_road_length += waylen(way);
-            }
-            else if (!strcmp(hwy, "residential"))
-            {
-                double l = waylen(way);
-                residential_road_length += l;
-                if (way.tags().get_value_by_key("name")) residential_road_with_name_length += l;
-            }
-            else if (!strcmp(hwy, "service") || !strcmp(hwy, "path") || !strcmp(hwy, "footway") || !strcmp(hwy, "cycleway") || !strcmp(hwy, "track"))
-            {
-                path_length += waylen(way);
-            }
-            return; 
-        }
-        const char *wwy = way.tags().get_value_by_key("waterway");
-        if (wwy)
-        {
-            if (!strcmp(wwy, "river"))
-            {
-                river_length += waylen(way);
-            }
-            return;
-        }
-        const char *rwy = way.tags().get_value_by_key("railway");
-        if (rwy)
+        std::cout << StatisticsHandler::metric_label(i) << std::llround(estimator.total(i)) << " +/- " << std::llround(estimator.margin(i)) << std::endl;
+    }
+}
+
+/* ================================================== */
+
+/*
+  Keeps track of where the ways and relations start in a checkpointed
+  run. chunk_offset must be set to the offset of each chunk before it is
+  read.
+*/
+class PhaseHandler : public osmium::handler::Handler
+{
+
+public:
+
+    uint64_t chunk_offset = 0;
+
+    // offset of the first chunk containing ways, 0 before that
+    uint64_t ways_offset = 0;
+
+    // all ways have been read (and all areas counted) once a chunk
+    // containing relations has been completed
+    bool relations_seen = false;
+
+    void way(const osmium::Way&)
+    {
+        if (!ways_offset) ways_offset = chunk_offset;
+    }
+
+    void relation(const osmium::Relation&)
+    {
+        relations_seen = true;
+    }
+
+    // see checkpoint.hpp
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        archive.field(ways_offset);
+        archive.field(relations_seen);
+    }
+
+};
+
+/*
+  The node locations of a checkpointed run, in a file next to the
+  checkpoint (FILE.locations). Every checkpoint first appends the
+  locations added to the index since the previous one, so a resumed run
+  loads them instead of decoding all node blocks again. This relies on
+  the index keeping its order, which it does for input sorted by node
+  id; for other input the journal stops and a resumed run reads the
+  nodes again.
+*/
+class LocationJournal
+{
+
+private:
+    struct Record
+    {
+        osmium::unsigned_object_id_type id;
+        osmium::Location location;
+    };
+
+    static const size_t batch_records = 1024 * 1024;
+
+    std::string filename;
+    int fd;
+
+    // number of records saved, the file may hold more from an
+    // interrupted checkpoint
+    uint64_t count = 0;
+    osmium::unsigned_object_id_type last_id = 0;
+    bool sorted = true;
+
+    void error(const std::string& message) const
+    {
+        throw std::runtime_error(filename + ": " + message);
+    }
+
+public:
+
+    LocationJournal(const std::string& filename, bool resume) : filename(filename)
+    {
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0666);
+        if (fd < 0) error(strerror(errno));
+    }
+
+    ~LocationJournal()
+    {
+        ::close(fd);
+    }
+
+    LocationJournal(const LocationJournal&) = delete;
+    LocationJournal& operator=(const LocationJournal&) = delete;
+
+    // whether load() restores all locations of the checkpoint
+    bool usable() const
+    {
+        return sorted;
+    }
+
+    // appends the new entries of the index to the file
+    void save(const index_type& index)
+    {
+        if (!sorted) return;
+        std::vector<Record> records;
+        records.reserve(std::min<size_t>(batch_records, index.size() - count));
+        auto it = index.begin() + count;
+        while (it != index.end())
         {
-            if (!strcmp(rwy, "rail") || !strcmp(rwy, "light_rail"))
+            records.clear();
+            for (; it != index.end() && records.size() < batch_records; ++it)
             {
-                railway_length += waylen(way);
+                if (it->first <= last_id && count + records.size())
+                {
+                    sorted = false;
+                    return;
+                }
+                last_id = it->first;
+                records.push_back(Record{it->first, it->second});
             }
-            return;
-        }
-        const char *pwr = way.tags().get_value_by_key("power");
-        if (pwr)
-        {
-            if (!strcmp(pwr, "line") || !strcmp(pwr, "minor_line"))
+            const char *p = reinterpret_cast<const char *>(records.data());
+            size_t size = records.size() * sizeof(Record);
+            off_t offset = count * sizeof(Record);
+            while (size)
             {
-                powerline_length += waylen(way);
+                ssize_t n = pwrite(fd, p, size, offset);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) error(strerror(errno));
+                p += n;
+                size -= n;
+                offset += n;
             }
-            return;
+            count += records.size();
         }
-        count_misc(way.tags());
+        if (fsync(fd)) error(strerror(errno));
     }
 
-    void node(const osmium::Node& node)
+    // adds the saved locations to the empty index
+    void load(index_type& index)
     {
-        if (node.tags().get_value_by_key("place"))
+        std::vector<Record> records(batch_records);
+        for (uint64_t done = 0; done < count; )
         {
-            if (node.tags().get_value_by_key("name")) place_count++;
-        }
-        else if (node.tags().get_value_by_key("addr:housenumber"))
-        {
-            housenumber_count++;
-        }
-        else 
-        {
-            count_misc(node.tags());
+            size_t n = std::min<uint64_t>(batch_records, count - done);
+            size_t size = n * sizeof(Record);
+            if (pread(fd, records.data(), size, done * sizeof(Record)) != ssize_t(size)) error("truncated");
+            for (size_t i = 0; i < n; i++) index.set(records[i].id, records[i].location);
+            done += n;
         }
+        index.sort();
     }
 
-    void print()
+    // see checkpoint.hpp
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
     {
-        bool csv = false;
-        if (csv)
-        {
-            std::cout <<
-                "motorways and trunk roads km,"
-                "primary and secondary roads km,"
-                "other connecting roads km,"
-                "residential roads km,"
-                "residential roads with names km,"
-                "tracks/paths km,"
-                "rivers km,"
-                "railways km,"
-                "power lines km,"
-                "buildings,"
-                "house numbers,"
-                "named places,"
-                "forest/meadow landcover count,"
-                "water area landcover count,"
-                "residential/industrial zone count,"
-                "agricultural landuse count,"
-                "POIs power,"
-                "POIs transport,"
-                "POIs public,"
-                "POIs hospitality,"
-                "POIs shop/bank,"
-                "POIs religion,"
-                "POIs other" << std::endl;
-
-            std::cout <<
-                (int) (motorway_trunk_length / 1000) << "," <<
-                (int) (primary_secondary_length / 1000) << "," <<
-                (int) (other_road_length / 1000) << "," <<
-                (int) (residential_road_length / 1000) << "," <<
-                (int) (residential_road_with_name_length / 1000) << "," <<
-                (int) (path_length / 1000) << "," <<
-                (int) (river_length / 1000) << "," <<
-                (int) (railway_length / 1000) << "," <<
-                (int) (powerline_length / 1000) << "," <<
-                building_count << "," <<
-                housenumber_count << "," <<
-                place_count << "," <<
-                landuse_green_count << "," <<
-                landuse_blue_count << "," <<
-                landuse_zone_count  << "," <<
-                landuse_agri_count  << "," <<
-                poi_power_count << "," <<
-                poi_traffic_count << "," <<
-                poi_public_count << "," <<
-                poi_hospitality_count << "," <<
-                poi_shop_count << "," <<
-                poi_religion_count << "," <<
-                poi_other_count << std::endl;
-        }
-        else
-        {
-            std::cout << "motorways and trunk roads km........"  <<  (int) (motorway_trunk_length / 1000)             << std::endl;
-            std::cout << "primary and secondary roads km......"  <<  (int) (primary_secondary_length / 1000)          << std::endl;
-            std::cout << "other connecting roads km..........."  <<  (int) (other_road_length / 1000)                 << std::endl;
-            std::cout << "residential roads km................"  <<  (int) (residential_road_length / 1000)           << std::endl;
-            std::cout << "residential roads with names km....."  <<  (int) (residential_road_with_name_length / 1000) << std::endl;
-            std::cout << "tracks/paths km....................."  <<  (int) (path_length / 1000)                       << std::endl;
-            std::cout << "rivers km..........................."  <<  (int) (river_length / 1000)                      << std::endl;
-            std::cout << "railways km........................."  <<  (int) (railway_length / 1000)                    << std::endl;
-            std::cout << "power lines km......................"  <<  (int) (powerline_length / 1000)                  << std::endl;
-            std::cout << "buildings..........................."  <<  building_count                                   << std::endl;
-            std::cout << "house numbers......................."  <<  housenumber_count                                << std::endl;
-            std::cout << "named places........................"  <<  place_count                                      << std::endl;
-            std::cout << "forest/meadow landcover count......."  <<  landuse_green_count                              << std::endl;
-            std::cout << "water area landcover count.........."  <<  landuse_blue_count                               << std::endl;
-            std::cout << "residential/industrial zone count..."  <<  landuse_zone_count                               << std::endl;
-            std::cout << "agricultural landuse count.........."  <<  landuse_agri_count                               << std::endl;
-            std::cout << "POIs power.........................."  <<  poi_power_count                                  << std::endl;
-            std::cout << "POIs transport......................"  <<  poi_traffic_count                                << std::endl;
-            std::cout << "POIs public........................."  <<  poi_public_count                                 << std::endl;
-            std::cout << "POIs hospitality...................."  <<  poi_hospitality_count                            << std::endl;
-            std::cout << "POIs shop/bank......................"  <<  poi_shop_count                                   << std::endl;
-            std::cout << "POIs religion......................."  <<  poi_religion_count                               << std::endl;
-            std::cout << "POIs other.........................."  <<  poi_other_count                                  << std::endl;
-        }
-
+        archive.field(count);
+        archive.field(last_id);
+        archive.field(sorted);
     }
 
+};
 
-private:
-
-double waylen(const osmium::Way& way)
+void usage(const char *prg)
 {
-    return osmium::geom::haversine::distance(way.nodes());
+    std::cerr << "Usage: " << prg << " [-c FILE [-i MIN] [-r]] [-s FRACTION [-S SEED]] [-j [--junction-tmpdir DIR]]" << std::endl;
+    std::cerr << "       [-u FILE [-n N] [--top-by COLUMN]] OSMFILE" << std::endl;
+    std::cerr << "  -c, --checkpoint FILE  save the statistics to FILE from time to time (PBF" << std::endl;
+    std::cerr << "                         input only), and the node locations to FILE.locations;" << std::endl;
+    std::cerr << "                         both are removed when the run completes" << std::endl;
+    std::cerr << "  -i, --checkpoint-interval MIN" << std::endl;
+    std::cerr << "                         minutes between checkpoints (default: 10)" << std::endl;
+    std::cerr << "  -r, --resume           continue an interrupted run from the checkpoint FILE" << std::endl;
+    std::cerr << "  -s, --sample FRACTION  only read this fraction (0..1] of the blocks of a PBF" << std::endl;
+    std::cerr << "                         file, chosen at random, and print estimates" << std::endl;
+    std::cerr << "  -S, --seed N           seed for choosing the blocks (default: 1)" << std::endl;
+    std::cerr << "  -j, --junctions        count road intersections and dead ends (reads the ways" << std::endl;
+    std::cerr << "                         a second time)" << std::endl;
+    std::cerr << "      --junction-tmpdir DIR" << std::endl;
+    std::cerr << "                         keep the node degrees of --junctions in a" << std::endl;
+    std::cerr << "                         temporary file in DIR instead of in memory" << std::endl;
+    std::cerr << "  -u, --by-user FILE     also write the statistics per user (uid) who last" << std::endl;
+    std::cerr << "                         edited the objects to FILE as CSV (- for stdout)" << std::endl;
+    std::cerr << "  -n, --top N            only write the N users with the largest values" << std::endl;
+    std::cerr << "      --top-by COLUMN    the CSV column ranking the users (default: objects)" << std::endl;
 }
 
-};
-
-/* ================================================== */
-
-// The type of index used. This must match the include file above
-using index_type = osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location>;
-
-// The location handler always depends on the index type
-using location_handler_type = osmium::handler::NodeLocationsForWays<index_type>;
-
 int main(int argc, char* argv[]) 
 {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " OSMFILE" << std::endl;
+    static struct option long_options[] = {
+        {"by-user", required_argument, 0, 'u'},
+        {"checkpoint", required_argument, 0, 'c'},
+        {"checkpoint-interval", required_argument, 0, 'i'},
+        {"help", no_argument, 0, 'h'},
+        {"junctions", no_argument, 0, 'j'},
+        {"junction-tmpdir", required_argument, 0, 'J'},
+        {"resume", no_argument, 0, 'r'},
+        {"sample", required_argument, 0, 's'},
+        {"seed", required_argument, 0, 'S'},
+        {"top", required_argument, 0, 'n'},
+        {"top-by", required_argument, 0, 'B'},
+        {0, 0, 0, 0}
+    };
+
+    std::string checkpoint_file;
+    unsigned int checkpoint_interval = 10;
+    bool resume = false;
+    double sample = 0;
+    uint64_t seed = 1;
+    bool junctions = false;
+    std::string junction_tmpdir;
+    std::string by_user_file;
+    size_t top = 0;
+    size_t top_by = 0;
+
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "c:hi:jn:rs:S:u:", long_options, 0);
+        if (c == -1) break;
+
+        switch (c)
+        {
+            case 'c':
+                checkpoint_file = optarg;
+                break;
+            case 'i':
+                checkpoint_interval = positive_option(optarg, "checkpoint-interval", 100000);
+                break;
+            case 'r':
+                resume = true;
+                break;
+            case 's':
+                sample = atof(optarg);
+                if (sample <= 0 || sample > 1)
+                {
+                    std::cerr << "--sample requires a fraction between 0 and 1" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'S':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'j':
+                junctions = true;
+                break;
+            case 'J':
+                junction_tmpdir = optarg;
+                break;
+            case 'u':
+                by_user_file = optarg;
+                break;
+            case 'n':
+                top = positive_option(optarg, "top", 100000000);
+                break;
+            case 'B':
+                top_by = UserStatistics::find_column(optarg);
+                if (top_by == UserStatistics::columns)
+                {
+                    std::cerr << "--top-by: unknown column " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            default:
+                exit(1);
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (resume && checkpoint_file.empty()) {
+        std::cerr << "--resume requires --checkpoint" << std::endl;
+        exit(1);
+    }
+    if (junctions && (sample > 0 || !checkpoint_file.empty()))
+    {
+        std::cerr << "--junctions cannot be combined with --sample or --checkpoint" << std::endl;
+        exit(1);
+    }
+    if (!by_user_file.empty() && (sample > 0 || !checkpoint_file.empty()))
+    {
+        std::cerr << "--by-user cannot be combined with --sample or --checkpoint" << std::endl;
         exit(1);
     }
 
+    if (sample > 0)
+    {
+        if (!checkpoint_file.empty())
+        {
+            std::cerr << "--sample cannot be combined with --checkpoint" << std::endl;
+            exit(1);
+        }
+        if (osmium::io::File{argv[optind]}.format() != osmium::io::file_format::pbf)
+        {
+            std::cerr << "--sample requires PBF input" << std::endl;
+            exit(1);
+        }
+        sample_statistics(argv[optind], sample, seed);
+        return 0;
+    }
+
     StatisticsHandler stat_handler;
 
+    // With --junctions, the statistics handler counts the degree of each
+    // road node while reading the ways.
+    std::unique_ptr<NodeRefCounter> node_refs;
+    if (junctions)
+    {
+        node_refs.reset(new NodeRefCounter(junction_tmpdir));
+        stat_handler.enable_junctions(node_refs.get());
+    }
+
+    // With --by-user, the objects go through the user handler, which
+    // passes them on to the statistics handler.
+    UserStatistics user_table;
+    std::unique_ptr<UserStatisticsHandler> user_handler;
+    if (!by_user_file.empty()) user_handler.reset(new UserStatisticsHandler(stat_handler, user_table));
+
     // Initialize an empty DynamicHandler. Later it will be associated
     // with one of the handlers. You can think of the DynamicHandler as
     // a kind of "variant handler" or a "pointer handler" pointing to the
@@ -385,6 +458,7 @@ int main(int argc, char* argv[])
     osmium::handler::DynamicHandler handler;
 
     osmium::io::File input_file{argv[optind]};
+    InputFile input{input_file};
 
     // Configuration for the multipolygon assembler. Here the default settings
     // are used, but you could change multiple settings.
@@ -398,9 +472,10 @@ int main(int argc, char* argv[])
 
     // We read the input file twice. In the first pass, only relations are
     // read and fed into the multipolygon collector.
-    osmium::io::Reader reader1{input_file, osmium::osm_entity_bits::relation};
+    osmium::io::Reader reader1{input.open(), osmium::osm_entity_bits::relation};
     collector.read_relations(reader1);
     reader1.close();
+    input.close();
 
     // The index storing all node locations.
     index_type index;
@@ -418,12 +493,127 @@ int main(int argc, char* argv[])
     // node location handler and then the multipolygon collector. The collector
     // will put the areas it has created into the "buffer" which are then
     // fed through our "handler".
-    osmium::io::Reader reader2{input_file};
-    osmium::apply(reader2, location_handler, stat_handler, collector.handler([&stat_handler](osmium::memory::Buffer&& buffer) {
-        osmium::apply(buffer, stat_handler);
-    }));
-    reader2.close();
+    bool replaying = false;
+    auto area_handler = collector.handler([&stat_handler, &user_handler, &replaying](osmium::memory::Buffer&& buffer) {
+        if (replaying) return;
+        if (user_handler) osmium::apply(buffer, *user_handler);
+        else osmium::apply(buffer, stat_handler);
+    });
+
+    if (checkpoint_file.empty())
+    {
+        osmium::io::Reader reader2{input.open()};
+        if (user_handler) osmium::apply(reader2, location_handler, *user_handler, area_handler);
+        else osmium::apply(reader2, location_handler, stat_handler, area_handler);
+        reader2.close();
+        input.close();
+    }
+    else
+    {
+        if (input_file.format() != osmium::io::file_format::pbf)
+        {
+            std::cerr << "--checkpoint requires PBF input" << std::endl;
+            exit(1);
+        }
+
+        // The input is read in chunks of PBF blocks, the statistics are
+        // saved between two chunks.
+        PbfBlockReader blocks{argv[optind]};
+        CheckpointInfo info;
+        info.program = "osmstats";
+        info.input_size = blocks.size();
+        std::string chunk;
+        PhaseHandler phases;
+        LocationJournal journal{checkpoint_file + ".locations", resume};
+
+        if (resume)
+        {
+            CheckpointReader in{checkpoint_file};
+            CheckpointInfo saved;
+            saved.checkpoint(in);
+            if (!saved.compatible(info))
+            {
+                std::cerr << checkpoint_file << " was written for another input file" << std::endl;
+                exit(1);
+            }
+            stat_handler.checkpoint(in);
+            phases.checkpoint(in);
+            journal.checkpoint(in);
+
+            // Once the relations have been reached, all ways and areas
+            // have been counted and nothing but the counters is needed.
+            // Otherwise the node locations come from the journal and the
+            // ways collected for multipolygons are restored by reading the
+            // ways up to the checkpoint again, dropping the areas that
+            // were already counted. The node blocks are only read again
+            // if the journal could not be kept.
+            osmium::osm_entity_bits::type replay_types = osmium::osm_entity_bits::way;
+            if (phases.relations_seen)
+            {
+                blocks.seek(saved.offset);
+            }
+            else if (journal.usable())
+            {
+                journal.load(index);
+                if (phases.ways_offset) blocks.seek(phases.ways_offset);
+                else blocks.seek(saved.offset);
+            }
+            else
+            {
+                replay_types |= osmium::osm_entity_bits::node;
+            }
+
+            replaying = true;
+            while (blocks.next_chunk(chunk, 64 * 1024 * 1024, saved.offset))
+            {
+                osmium::io::Reader reader{osmium::io::File(chunk.data(), chunk.size(), "pbf"), replay_types};
+                osmium::apply(reader, location_handler, area_handler);
+                reader.close();
+            }
+            replaying = false;
+        }
+
+        CheckpointTimer timer{checkpoint_interval};
+        while (true)
+        {
+            phases.chunk_offset = blocks.offset();
+            if (!blocks.next_chunk(chunk)) break;
+            // apply() flushes the collector at the end of the chunk, so all
+            // areas completed in the chunk are counted before a checkpoint
+            osmium::io::Reader reader{osmium::io::File(chunk.data(), chunk.size(), "pbf")};
+            osmium::apply(reader, location_handler, stat_handler, area_handler, phases);
+            reader.close();
+            if (!timer.due()) continue;
+            if (!phases.relations_seen) journal.save(index);
+            CheckpointWriter out{checkpoint_file};
+            info.offset = blocks.offset();
+            info.checkpoint(out);
+            stat_handler.checkpoint(out);
+            phases.checkpoint(out);
+            journal.checkpoint(out);
+            out.commit();
+        }
+    }
+
+    // For --junctions the ways are read once more, now that the counts
+    // are complete, to find the intersections and dead ends of each road.
+    if (node_refs)
+    {
+        JunctionHandler junction_handler{stat_handler};
+        osmium::io::Reader reader3{input.open(), osmium::osm_entity_bits::way};
+        osmium::apply(reader3, junction_handler);
+        reader3.close();
+        input.close();
+    }
 
     stat_handler.print();
+
+    if (user_handler) user_table.write_csv(by_user_file, top, top_by);
+
+    if (!checkpoint_file.empty())
+    {
+        unlink(checkpoint_file.c_str());
+        unlink((checkpoint_file + ".locations").c_str());
+    }
 }
 
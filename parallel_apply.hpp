@@ -0,0 +1,217 @@
+#ifndef PARALLEL_APPLY_HPP
+#define PARALLEL_APPLY_HPP
+
+/*
+  Distributes the buffers read from an osmium::io::Reader to a number
+  of worker threads. Every worker has an index (0 .. threads-1) so that
+  it can feed the buffers into a handler of its own; buffers are handed
+  out in file order, but may be processed in any order.
+
+  If nodes_first is set, the first buffer containing anything other
+  than nodes is only handed out once all buffers before it have been
+  processed completely, so that all node data is available when the
+  ways are processed.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <osmium/io/reader.hpp>
+#include <osmium/memory/buffer.hpp>
+
+inline bool buffer_has_only_nodes(osmium::memory::Buffer& buffer)
+{
+    for (const auto& item : buffer)
+    {
+        if (item.type() != osmium::item_type::node) return false;
+    }
+    return true;
+}
+
+template <typename TFunc>
+void parallel_apply(osmium::io::Reader& reader, size_t threads, TFunc func, bool nodes_first = false)
+{
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::condition_variable idle;
+    size_t busy = 0;
+    std::deque<osmium::memory::Buffer> queue;
+    const size_t max_queue_size = threads * 2;
+    bool done = false;
+    std::exception_ptr error;
+
+    auto worker = [&](size_t index) {
+        while (true)
+        {
+            osmium::memory::Buffer buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [&] { return done || !queue.empty(); });
+                if (queue.empty()) return;
+                buffer = std::move(queue.front());
+                queue.pop_front();
+                busy++;
+            }
+            not_full.notify_one();
+            try
+            {
+                func(index, buffer);
+                std::lock_guard<std::mutex> lock(mutex);
+                busy--;
+                if (!busy && queue.empty()) idle.notify_all();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                done = true;
+                queue.clear();
+                not_full.notify_all();
+                not_empty.notify_all();
+                idle.notify_all();
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) workers.emplace_back(worker, i);
+
+    try
+    {
+        bool nodes_done = !nodes_first;
+        while (osmium::memory::Buffer buffer = reader.read())
+        {
+            if (!nodes_done && !buffer_has_only_nodes(buffer))
+            {
+                nodes_done = true;
+                std::unique_lock<std::mutex> lock(mutex);
+                idle.wait(lock, [&] { return done || (!busy && queue.empty()); });
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&] { return done || queue.size() < max_queue_size; });
+            if (done) break;
+            queue.push_back(std::move(buffer));
+            lock.unlock();
+            not_empty.notify_one();
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = std::current_exception();
+        queue.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    not_empty.notify_all();
+    for (std::thread& t : workers) t.join();
+
+    if (error) std::rethrow_exception(error);
+}
+
+/*
+  Hands every buffer read to each of the stages. Every stage runs in a
+  thread of its own and sees all buffers in file order, so the stages
+  work at the same time and the slowest one sets the pace. The stages
+  share the buffers: with more than one stage they must not modify
+  them. The reader runs at most max_queue_size buffers ahead of the
+  slowest stage.
+*/
+inline void pipeline_apply(osmium::io::Reader& reader, const std::vector<std::function<void(osmium::memory::Buffer&)>>& stages, size_t max_queue_size = 4)
+{
+    typedef std::shared_ptr<osmium::memory::Buffer> buffer_ptr;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::vector<std::deque<buffer_ptr>> queues(stages.size());
+    bool done = false;
+    bool failed = false;
+    std::exception_ptr error;
+
+    auto worker = [&](size_t index) {
+        while (true)
+        {
+            buffer_ptr buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [&] { return failed || done || !queues[index].empty(); });
+                if (failed || queues[index].empty()) return;
+                buffer = std::move(queues[index].front());
+                queues[index].pop_front();
+            }
+            not_full.notify_one();
+            try
+            {
+                stages[index](*buffer);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+                not_full.notify_all();
+                not_empty.notify_all();
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < stages.size(); i++) workers.emplace_back(worker, i);
+
+    auto room = [&] {
+        for (const auto& queue : queues)
+        {
+            if (queue.size() >= max_queue_size) return false;
+        }
+        return true;
+    };
+
+    try
+    {
+        while (osmium::memory::Buffer buffer = reader.read())
+        {
+            buffer_ptr shared = std::make_shared<osmium::memory::Buffer>(std::move(buffer));
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&] { return failed || room(); });
+            if (failed) break;
+            for (auto& queue : queues) queue.push_back(shared);
+            lock.unlock();
+            not_empty.notify_all();
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = std::current_exception();
+        failed = true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    not_empty.notify_all();
+    for (std::thread& t : workers) t.join();
+
+    if (error) std::rethrow_exception(error);
+}
+
+#endif // PARALLEL_APPLY_HPP
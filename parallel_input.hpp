@@ -0,0 +1,430 @@
+#ifndef PARALLEL_INPUT_HPP
+#define PARALLEL_INPUT_HPP
+
+/*
+  Input files of the tools. bzip2 files that consist of many streams
+  (as written by pbzip2 and lbzip2 and published by most mirrors) are
+  decompressed in parallel; all other input is read by libosmium as
+  usual.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bzlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <osmium/io/file.hpp>
+
+/*
+  Decompresses bzip2 data read from a file descriptor. The input is
+  read ahead and cut at stream starts ("BZh1".."BZh9" followed by the
+  block magic "1AY&SY") into pieces of at least min_piece bytes, which
+  are decompressed by up to 'threads' tasks at a time. read() returns
+  the decompressed data in order. A stream larger than max_piece (as in
+  files written by plain bzip2) switches to sequential decompression.
+  Like bzip2, data after the last stream that is not a stream start is
+  ignored with a warning.
+*/
+class ParallelBzip2Decompressor
+{
+
+private:
+    static const size_t read_size = 4 * 1024 * 1024;
+    static const size_t min_piece = 1024 * 1024;
+    static const size_t max_piece = 64 * 1024 * 1024;
+    static const size_t output_size = 4 * 1024 * 1024;
+
+    int fd;
+    size_t threads;
+
+    // compressed data not yet handed to a task, starting at a stream
+    std::string input;
+    // no stream starts in input[min_piece, scanned)
+    size_t scanned = 0;
+    bool input_done = false;
+
+    // a decompressed piece, trailing_garbage is set if it ended with
+    // data that is not a bzip2 stream
+    struct Piece
+    {
+        std::string data;
+        bool trailing_garbage;
+    };
+
+    std::deque<std::future<Piece>> pieces;
+
+    bool sequential = false;
+    bz_stream stream;
+    bool stream_open = false;
+    bool streams_done = false;
+    bool finished = false;
+
+    static void warn_trailing_garbage()
+    {
+        std::cerr << "bzip2: trailing garbage after EOF ignored" << std::endl;
+    }
+
+    bool fill()
+    {
+        if (input_done) return false;
+        size_t old = input.size();
+        input.resize(old + read_size);
+        ssize_t n;
+        do
+        {
+            n = ::read(fd, &input[old], read_size);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) throw std::runtime_error(std::string("read error: ") + strerror(errno));
+        input.resize(old + n);
+        if (n == 0) input_done = true;
+        return n > 0;
+    }
+
+    static bool stream_start(const char *p)
+    {
+        return p[0] == 'B' && p[1] == 'Z' && p[2] == 'h' && p[3] >= '1' && p[3] <= '9' && !memcmp(p + 4, "1AY&SY", 6);
+    }
+
+    // position of the first stream start at or after min_piece, or
+    // std::string::npos
+    size_t find_cut()
+    {
+        const char *data = input.data();
+        size_t i = std::max(scanned, min_piece);
+        while (i + 10 <= input.size())
+        {
+            const void *b = memchr(data + i, 'B', input.size() - 9 - i);
+            if (!b) break;
+            i = static_cast<const char *>(b) - data;
+            if (stream_start(data + i)) return i;
+            i++;
+        }
+        scanned = input.size() > 9 ? input.size() - 9 : 0;
+        return std::string::npos;
+    }
+
+    // the next run of whole streams to decompress, false at the end of
+    // the input or if sequential decompression is needed
+    bool next_piece(std::string& piece)
+    {
+        while (true)
+        {
+            size_t cut = find_cut();
+            if (cut != std::string::npos)
+            {
+                piece.assign(input, 0, cut);
+                input.erase(0, cut);
+                scanned = 0;
+                return true;
+            }
+            if (input_done)
+            {
+                if (input.empty()) return false;
+                piece.swap(input);
+                input.clear();
+                scanned = 0;
+                return true;
+            }
+            if (input.size() > max_piece)
+            {
+                sequential = true;
+                return false;
+            }
+            fill();
+        }
+    }
+
+    static Piece decompress(const std::string& data)
+    {
+        Piece piece{std::string(), false};
+        std::string& out = piece.data;
+        size_t pos = 0;
+        while (pos < data.size())
+        {
+            // every piece starts with a stream, so anything else after a
+            // stream ends the data
+            if (pos > 0 && (data.size() - pos < 3 || data.compare(pos, 3, "BZh")))
+            {
+                piece.trailing_garbage = true;
+                break;
+            }
+            bz_stream s;
+            memset(&s, 0, sizeof(s));
+            if (BZ2_bzDecompressInit(&s, 0, 0) != BZ_OK) throw std::runtime_error("bzip2 error: initialization failed");
+            s.next_in = const_cast<char *>(data.data() + pos);
+            s.avail_in = data.size() - pos;
+            int result;
+            do
+            {
+                size_t old = out.size();
+                size_t grow = std::max(output_size, old);
+                out.resize(old + grow);
+                s.next_out = &out[old];
+                s.avail_out = grow;
+                result = BZ2_bzDecompress(&s);
+                out.resize(old + grow - s.avail_out);
+                if ((result != BZ_OK && result != BZ_STREAM_END) || (result == BZ_OK && s.avail_in == 0 && s.avail_out))
+                {
+                    BZ2_bzDecompressEnd(&s);
+                    throw std::runtime_error(result == BZ_OK ? "bzip2 error: unexpected end of data" : "bzip2 error: invalid data (" + std::to_string(result) + ")");
+                }
+            } while (result != BZ_STREAM_END);
+            pos = data.size() - s.avail_in;
+            BZ2_bzDecompressEnd(&s);
+        }
+        return piece;
+    }
+
+    std::string read_sequential()
+    {
+        std::string out;
+        while (out.empty())
+        {
+            if (!stream_open)
+            {
+                while (input.size() < 3 && fill()) {}
+                if (input.empty()) return out;
+                if (streams_done && input.compare(0, 3, "BZh"))
+                {
+                    warn_trailing_garbage();
+                    input.clear();
+                    finished = true;
+                    return out;
+                }
+                memset(&stream, 0, sizeof(stream));
+                if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) throw std::runtime_error("bzip2 error: initialization failed");
+                stream_open = true;
+                stream.next_in = &input[0];
+                stream.avail_in = input.size();
+            }
+            if (stream.avail_in == 0)
+            {
+                input.clear();
+                if (!fill()) throw std::runtime_error("bzip2 error: unexpected end of data");
+                stream.next_in = &input[0];
+                stream.avail_in = input.size();
+            }
+            out.resize(output_size);
+            stream.next_out = &out[0];
+            stream.avail_out = out.size();
+            int result = BZ2_bzDecompress(&stream);
+            out.resize(out.size() - stream.avail_out);
+            if (result == BZ_STREAM_END)
+            {
+                // the rest of the input is the start of the next stream
+                input.erase(0, input.size() - stream.avail_in);
+                BZ2_bzDecompressEnd(&stream);
+                stream_open = false;
+                streams_done = true;
+            }
+            else if (result != BZ_OK)
+            {
+                throw std::runtime_error("bzip2 error: invalid data (" + std::to_string(result) + ")");
+            }
+        }
+        return out;
+    }
+
+public:
+
+    ParallelBzip2Decompressor(int fd, size_t threads) : fd(fd), threads(std::max(threads, size_t(1))) {
+    }
+
+    ~ParallelBzip2Decompressor()
+    {
+        if (stream_open) BZ2_bzDecompressEnd(&stream);
+    }
+
+    ParallelBzip2Decompressor(const ParallelBzip2Decompressor&) = delete;
+    ParallelBzip2Decompressor& operator=(const ParallelBzip2Decompressor&) = delete;
+
+    // the next part of the decompressed data, empty at the end
+    std::string read()
+    {
+        while (!finished)
+        {
+            std::string piece;
+            while (!sequential && pieces.size() < threads && next_piece(piece))
+            {
+                pieces.push_back(std::async(std::launch::async, decompress, std::move(piece)));
+            }
+            if (pieces.empty()) return sequential ? read_sequential() : std::string();
+            Piece out = pieces.front().get();
+            pieces.pop_front();
+            if (out.trailing_garbage)
+            {
+                // the streams after the garbage are ignored as well
+                warn_trailing_garbage();
+                pieces.clear();
+                finished = true;
+            }
+            else
+            {
+                streams_done = true;
+            }
+            if (!out.data.empty()) return out.data;
+        }
+        return std::string();
+    }
+
+};
+
+/* ================================================== */
+
+/*
+  The input file of a tool. open() returns the File to be passed to an
+  osmium::io::Reader; it must be called again for every Reader. For
+  bzip2 input, every open() starts a thread that decompresses the file
+  with a ParallelBzip2Decompressor into a pipe, and the File refers to
+  the pipe (as /dev/fd/N), so that libosmium reads uncompressed data
+  and the handlers see no difference. A decompression error closes the
+  pipe and is rethrown by the next close() or open(), so close() should
+  be called after each Reader has been closed.
+*/
+class InputFile
+{
+
+private:
+    struct Decompression
+    {
+        int pipe;
+        std::thread thread;
+        std::shared_ptr<std::exception_ptr> error;
+    };
+
+    osmium::io::File file;
+    unsigned int threads;
+    std::vector<Decompression> running;
+
+    static bool write_all(int fd, const std::string& data)
+    {
+        size_t done = 0;
+        while (done < data.size())
+        {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    static void decompress(std::string filename, int out, unsigned int threads, std::shared_ptr<std::exception_ptr> error)
+    {
+        // a Reader that is closed early makes write() fail with EPIPE
+        // instead of killing the program with SIGPIPE
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+        int in = ::open(filename.c_str(), O_RDONLY);
+        try
+        {
+            if (in < 0) throw std::runtime_error(strerror(errno));
+            ParallelBzip2Decompressor decompressor(in, threads);
+            for (std::string data = decompressor.read(); !data.empty(); data = decompressor.read())
+            {
+                if (!write_all(out, data)) break;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            // the reader sees the end of the pipe, the error is reported
+            // by close()
+            *error = std::make_exception_ptr(std::runtime_error(filename + ": " + e.what()));
+        }
+        if (in >= 0) ::close(in);
+        ::close(out);
+    }
+
+    // returns the first error of the decompression threads
+    std::exception_ptr close_all()
+    {
+        std::exception_ptr error;
+        for (Decompression& d : running)
+        {
+            ::close(d.pipe);
+            d.thread.join();
+            if (!error) error = *d.error;
+        }
+        running.clear();
+        return error;
+    }
+
+public:
+
+    // threads is the number of decompression tasks, 0 for one per CPU
+    explicit InputFile(const osmium::io::File& file, unsigned int threads = 0) :
+        file(file),
+        threads(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u)) {
+    }
+
+    ~InputFile()
+    {
+        std::exception_ptr error = close_all();
+        if (!error) return;
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    // waits for the decompression of the last Reader, throws
+    // std::runtime_error if it failed
+    void close()
+    {
+        std::exception_ptr error = close_all();
+        if (error) std::rethrow_exception(error);
+    }
+
+    osmium::io::File open()
+    {
+        // the previous Reader is done
+        close();
+
+        if (file.compression() != osmium::io::file_compression::bzip2 || file.filename().empty() || file.filename() == "-") return file;
+        int fds[2];
+        if (pipe(fds)) return file;
+#ifdef F_SETPIPE_SZ
+        fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+        std::shared_ptr<std::exception_ptr> error = std::make_shared<std::exception_ptr>();
+        running.push_back(Decompression{fds[0], std::thread(decompress, file.filename(), fds[1], threads, error), error});
+
+        osmium::io::File pipe_file("/dev/fd/" + std::to_string(fds[0]));
+        pipe_file.set_format(file.format());
+        pipe_file.set_compression(osmium::io::file_compression::none);
+        return pipe_file;
+    }
+
+};
+
+#endif // PARALLEL_INPUT_HPP
@@ -0,0 +1,226 @@
+#ifndef PBF_BLOCKS_HPP
+#define PBF_BLOCKS_HPP
+
+/*
+  Reads a PBF file block by block without decoding the blocks. A PBF
+  file is a header block followed by data blocks, each framed by its
+  length and a BlobHeader. Blocks are kept with their framing, so the
+  header block followed by any run of data blocks is a valid PBF file
+  of its own, which can be read from memory with
+  osmium::io::File(data, size, "pbf"). This is what makes it possible
+  to start reading in the middle of a file (see checkpoint.hpp) and to
+  read only some of the blocks (osmstats --sample).
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class PbfBlockReader
+{
+
+private:
+    // limits from the PBF specification
+    static const uint32_t max_blob_header_size = 64 * 1024;
+    static const uint32_t max_blob_size = 32 * 1024 * 1024;
+
+    std::string filename;
+    int fd;
+    uint64_t position = 0;
+    uint64_t file_size = 0;
+    std::string header_block;
+
+    void error(const std::string& message) const
+    {
+        throw std::runtime_error(filename + ": " + message);
+    }
+
+    // returns false if the file ends before the first byte
+    bool read_exactly(char *data, size_t length)
+    {
+        size_t done = 0;
+        while (done < length)
+        {
+            ssize_t n = ::read(fd, data + done, length - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) error(strerror(errno));
+            if (n == 0)
+            {
+                if (done == 0) return false;
+                error("truncated PBF block");
+            }
+            done += n;
+        }
+        position += length;
+        return true;
+    }
+
+    uint64_t varint(const char *& p, const char *end) const
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (p == end) error("invalid BlobHeader");
+            uint8_t byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        error("invalid BlobHeader");
+        return 0;
+    }
+
+    // returns the datasize field of the BlobHeader, the type field is
+    // stored in type
+    uint64_t parse_blob_header(const char *p, const char *end, std::string& type) const
+    {
+        uint64_t datasize = 0;
+        while (p != end)
+        {
+            uint64_t key = varint(p, end);
+            switch (key & 7)
+            {
+                case 0:
+                {
+                    uint64_t value = varint(p, end);
+                    if ((key >> 3) == 3) datasize = value;
+                    break;
+                }
+                case 2:
+                {
+                    uint64_t length = varint(p, end);
+                    if (length > uint64_t(end - p)) error("invalid BlobHeader");
+                    if ((key >> 3) == 1) type.assign(p, length);
+                    p += length;
+                    break;
+                }
+                default:
+                    error("invalid BlobHeader");
+            }
+        }
+        return datasize;
+    }
+
+    // appends the framing and BlobHeader of the next block to data and
+    // returns the size of the blob that follows
+    bool append_block_header(std::string& data, std::string& type, uint64_t& blob_length)
+    {
+        unsigned char length_bytes[4];
+        if (!read_exactly(reinterpret_cast<char *>(length_bytes), 4)) return false;
+        uint32_t header_length = (uint32_t(length_bytes[0]) << 24) | (uint32_t(length_bytes[1]) << 16) | (uint32_t(length_bytes[2]) << 8) | length_bytes[3];
+        if (header_length > max_blob_header_size) error("invalid BlobHeader size");
+
+        size_t start = data.size();
+        data.append(reinterpret_cast<char *>(length_bytes), 4);
+        data.resize(start + 4 + header_length);
+        if (!read_exactly(&data[start + 4], header_length)) error("truncated PBF block");
+        blob_length = parse_blob_header(data.data() + start + 4, data.data() + data.size(), type);
+        if (blob_length > max_blob_size) error("invalid blob size");
+        return true;
+    }
+
+    // appends the next block with its framing to data
+    bool append_block(std::string& data, std::string& type)
+    {
+        uint64_t blob_length;
+        if (!append_block_header(data, type, blob_length)) return false;
+        size_t blob_start = data.size();
+        data.resize(blob_start + blob_length);
+        if (blob_length && !read_exactly(&data[blob_start], blob_length)) error("truncated PBF block");
+        return true;
+    }
+
+public:
+
+    // reads the header block, throws std::runtime_error if the file
+    // does not start with one
+    explicit PbfBlockReader(const std::string& filename) : filename(filename)
+    {
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) error(strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) == 0) file_size = st.st_size;
+        std::string type;
+        if (!append_block(header_block, type) || type != "OSMHeader") 
+        {
+            ::close(fd);
+            error("not a PBF file");
+        }
+    }
+
+    ~PbfBlockReader()
+    {
+        ::close(fd);
+    }
+
+    PbfBlockReader(const PbfBlockReader&) = delete;
+    PbfBlockReader& operator=(const PbfBlockReader&) = delete;
+
+    // the header block, with framing
+    const std::string& header() const
+    {
+        return header_block;
+    }
+
+    // position of the next block in the file
+    uint64_t offset() const
+    {
+        return position;
+    }
+
+    uint64_t size() const
+    {
+        return file_size;
+    }
+
+    // continues reading at the given offset, which must be the start of
+    // a data block (a value returned by offset())
+    void seek(uint64_t offset)
+    {
+        if (offset < header_block.size() || offset > file_size) error("invalid offset " + std::to_string(offset));
+        if (lseek(fd, offset, SEEK_SET) < 0) error(strerror(errno));
+        position = offset;
+    }
+
+    // Replaces chunk with the header block followed by the next data
+    // blocks, until the chunk has reached max_bytes or the offset end.
+    // Returns false if there is no block left.
+    bool next_chunk(std::string& chunk, size_t max_bytes = 64 * 1024 * 1024, uint64_t end = UINT64_MAX)
+    {
+        chunk = header_block;
+        std::string type;
+        while (position < end && (chunk.size() == header_block.size() || chunk.size() < max_bytes))
+        {
+            if (!append_block(chunk, type)) break;
+        }
+        return chunk.size() > header_block.size();
+    }
+
+    // Moves on to the next block without reading its contents. Returns
+    // false if there is no block left.
+    bool skip_block()
+    {
+        std::string framing;
+        std::string type;
+        uint64_t blob_length;
+        if (!append_block_header(framing, type, blob_length)) return false;
+        if (position + blob_length > file_size) error("truncated PBF block");
+        if (lseek(fd, blob_length, SEEK_CUR) < 0) error(strerror(errno));
+        position += blob_length;
+        return true;
+    }
+
+};
+
+#endif // PBF_BLOCKS_HPP
@@ -0,0 +1,662 @@
+#ifndef STATISTICS_HANDLER_HPP
+#define STATISTICS_HANDLER_HPP
+
+/*
+
+Handler that collects the statistics printed by osmstats, shared by
+osmstats and osmcombined.
+
+Frederik Ramm <frederik@remote.org>, public domain
+Ported 2016 to libosmium 2.9 by Philip Beelmann <beelmann@geofabik.de>
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <osmium/handler.hpp>
+#include <osmium/handler/node_locations_for_ways.hpp>
+#include <osmium/index/map/sparse_mem_array.hpp>
+#include <osmium/geom/haversine.hpp>
+#include <osmium/osm.hpp>
+
+#include "node_ref_counter.hpp"
+
+/* ================================================== */
+
+class StatisticsHandler : public osmium::handler::Handler
+{
+
+public:
+
+    enum road_class_type
+    {
+        road_motorway_trunk,
+        road_primary_secondary,
+        road_other,
+        road_residential,
+        road_path,
+        road_classes,
+        road_none = -1
+    };
+
+private:
+
+    double motorway_trunk_length = 0;
+    double primary_secondary_length = 0;
+    double other_road_length = 0;
+    double residential_road_with_name_length = 0;
+    double residential_road_length = 0;
+    double path_length = 0;
+
+    double river_length = 0;
+    double railway_length = 0;
+    double powerline_length = 0;
+    double water_area = 0;
+    double forest_area = 0;
+
+    int building_count = 0;
+    int housenumber_count = 0;
+    int place_count = 0;
+
+    int poi_power_count = 0;
+    int poi_traffic_count = 0;
+    int poi_other_count = 0;
+    int poi_public_count = 0;
+    int poi_hospitality_count = 0;
+    int poi_shop_count = 0;
+    int poi_religion_count = 0;
+
+    int landuse_green_count = 0;
+    int landuse_blue_count = 0;
+    int landuse_zone_count = 0;
+    int landuse_agri_count = 0;
+
+    std::function<double(const osmium::Way&)> length_function;
+
+    // --junctions: the degree of every node in the road network (the
+    // number of road segments meeting there, 3 meaning 3 or more), and
+    // the classification of the road nodes by classify_junctions()
+    NodeRefCounter *node_refs = nullptr;
+    uint64_t dead_ends[road_classes] = {};
+    uint64_t intersections[road_classes] = {};
+
+    // the node ids of the current way, see sort_node_ids() and
+    // count_node_degrees()
+    std::vector<osmium::object_id_type> way_node_ids;
+
+    static const char *road_class_name(int road_class)
+    {
+        static const char *const names[] = { "motorway/trunk", "primary/secondary", "tertiary/unclassified", "residential", "service/paths" };
+        return names[road_class];
+    }
+
+    // the label followed by dots, as in print()
+    static std::string dotted(const std::string& label)
+    {
+        return label + std::string(label.size() < 36 ? 36 - label.size() : 0, '.');
+    }
+
+    // fills way_node_ids with the (positive) node ids of the way in
+    // sorted order, including repeated ones
+    void sort_node_ids(const osmium::Way& way)
+    {
+        way_node_ids.clear();
+        for (const osmium::NodeRef& node : way.nodes())
+        {
+            if (node.ref() > 0) way_node_ids.push_back(node.ref());
+        }
+        std::sort(way_node_ids.begin(), way_node_ids.end());
+    }
+
+    // Adds the road segments of the way to the degrees of its nodes: 1
+    // for an end node, 2 for an interior one (repeated consecutive nodes
+    // are no segment). A node where a road is split into two ways gets
+    // degree 2 like any other node along the road.
+    void count_node_degrees(const osmium::Way& way)
+    {
+        way_node_ids.clear();
+        for (const osmium::NodeRef& node : way.nodes())
+        {
+            if (way_node_ids.empty() || way_node_ids.back() != node.ref()) way_node_ids.push_back(node.ref());
+        }
+        if (way_node_ids.size() < 2) return;
+        for (size_t i = 0; i < way_node_ids.size(); i++)
+        {
+            if (way_node_ids[i] <= 0) continue;
+            node_refs->add(way_node_ids[i], i == 0 || i == way_node_ids.size() - 1 ? 1 : 2);
+        }
+    }
+
+    // a node at which only a single road segment ends
+    bool dead_end(osmium::object_id_type id) const
+    {
+        return id > 0 && node_refs->get(id) == 1;
+    }
+
+public:
+
+    static int road_class(const char *hwy)
+    {
+        if (!strcmp(hwy, "motorway") || !strcmp(hwy, "trunk")) return road_motorway_trunk;
+        if (!strcmp(hwy, "primary") || !strcmp(hwy, "secondary")) return road_primary_secondary;
+        if (!strcmp(hwy, "tertiary") || !strcmp(hwy, "unclassified")) return road_other;
+        if (!strcmp(hwy, "residential")) return road_residential;
+        if (!strcmp(hwy, "service") || !strcmp(hwy, "path") || !strcmp(hwy, "footway") || !strcmp(hwy, "cycleway") || !strcmp(hwy, "track")) return road_path;
+        return road_none;
+    }
+
+    void count_misc(const osmium::TagList& tags)
+    {
+        const char *t = tags.get_value_by_key("landuse");
+        if (t)
+        {
+            if (!strcmp(t, "forest") || !strcmp(t, "grass") || !strcmp(t, "meadow"))
+            {
+                landuse_green_count++;
+            }
+            else if (!strcmp(t, "residential") || !strcmp(t, "industrial") || !strcmp(t, "commercial") || !strcmp(t, "military"))
+            {
+                landuse_zone_count++;
+            }
+            else if (!strcmp(t, "farmland") || !strcmp(t, "farm") || !strcmp(t, "farmyard"))
+            {
+                landuse_agri_count++;
+            }
+        }
+        t = tags.get_value_by_key("amenity");
+        if (t)
+        {
+            if (!strcmp(t, "restaurant") || !strcmp(t, "cafe") || !strcmp(t, "fast_food") || !strcmp(t, "pub") || !strcmp(t, "bar"))
+            {
+                poi_hospitality_count++;
+            }
+            else if (!strcmp(t, "fuel") || !strcmp(t, "parking"))
+            {
+                poi_traffic_count++;
+            }
+            else if (!strcmp(t, "place_of_worship"))
+            {
+                poi_religion_count++;
+            }
+            else if (!strcmp(t, "school") || !strcmp(t, "public_building") || !strcmp(t, "kindergarten") || !strcmp(t, "hospital") || !strcmp(t, "post_office"))
+            {
+                poi_public_count++;
+            }
+            else if (!strcmp(t, "atm") || !strcmp(t, "bank"))
+            {
+                poi_shop_count++;
+            }
+            else
+            {
+                poi_other_count++;
+            }
+        }
+        if (tags.get_value_by_key("shop"))  poi_shop_count++;
+        t = tags.get_value_by_key("tourism");
+        if (t)
+        {
+            if (!strcmp(t, "hotel") || !strcmp(t, "motel") || !strcmp(t, "camp_site") || !strcmp(t, "hostel"))
+            {
+                poi_hospitality_count++;
+            }
+            else if (!strcmp(t, "museum"))
+            {
+                poi_public_count++;
+            }
+            else
+            {
+                poi_other_count++;
+            }
+        }
+        t = tags.get_value_by_key("highway");
+        if (t)
+        {
+            if (!strcmp(t, "bus_stop"))
+            {
+                poi_traffic_count++;
+            }
+        }
+        t = tags.get_value_by_key("aeroway");
+        if (t)
+        {
+            if (!strcmp(t, "aerodrome"))
+            {
+                poi_traffic_count++;
+            }
+        }
+        t = tags.get_value_by_key("railway");
+        if (t)
+        {
+            if (!strcmp(t, "station") || !strcmp(t, "halt"))
+            {
+                poi_traffic_count++;
+            }
+        }
+        t = tags.get_value_by_key("power");
+        if (t)
+        {
+            if (!strcmp(t, "station") || !strcmp(t, "generator") || !strcmp(t, "transformer"))
+            {
+                poi_power_count++;
+            }
+        }
+        t = tags.get_value_by_key("natural");
+        if (t)
+        {
+            if (!strcmp(t, "wood"))
+            {
+                landuse_green_count++;
+            }
+            else if (!strcmp(t, "water"))
+            {
+                landuse_blue_count++;
+            }
+        }
+    }
+
+
+    void area(const osmium::Area& area)
+    {
+        area_tags(area.tags());
+    }
+
+    // counts an area known only by its tags, see osmstats --sample
+    void area_tags(const osmium::TagList& tags)
+    {
+        if (tags.get_value_by_key("building"))
+        {
+            building_count++;
+        }
+        if (tags.get_value_by_key("addr_housenumber"))
+        {
+            housenumber_count++;
+        }
+        count_misc(tags);
+    }
+
+    void way(const osmium::Way& way)
+    {
+        const char *hwy = way.tags().get_value_by_key("highway");
+        if (hwy)
+        {
+            int rc = road_class(hwy);
+            if (node_refs && rc != road_none) count_node_degrees(way);
+            switch (rc)
+            {
+                case road_motorway_trunk:
+                    motorway_trunk_length += waylen(way);
+                    break;
+                case road_primary_secondary:
+                    primary_secondary_length += waylen(way);
+                    break;
+                case road_other:
+                    other_road_length += waylen(way);
+                    break;
+                case road_residential:
+                {
+                    double l = waylen(way);
+                    residential_road_length += l;
+                    if (way.tags().get_value_by_key("name")) residential_road_with_name_length += l;
+                    break;
+                }
+                case road_path:
+                    path_length += waylen(way);
+                    break;
+                default:
+                    break;
+            }
+            return; 
+        }
+        const char *wwy = way.tags().get_value_by_key("waterway");
+        if (wwy)
+        {
+            if (!strcmp(wwy, "river"))
+            {
+                river_length += waylen(way);
+            }
+            return;
+        }
+        const char *rwy = way.tags().get_value_by_key("railway");
+        if (rwy)
+        {
+            if (!strcmp(rwy, "rail") || !strcmp(rwy, "light_rail"))
+            {
+                railway_length += waylen(way);
+            }
+            return;
+        }
+        const char *pwr = way.tags().get_value_by_key("power");
+        if (pwr)
+        {
+            if (!strcmp(pwr, "line") || !strcmp(pwr, "minor_line"))
+            {
+                powerline_length += waylen(way);
+            }
+            return;
+        }
+        count_misc(way.tags());
+    }
+
+    void node(const osmium::Node& node)
+    {
+        if (node.tags().get_value_by_key("place"))
+        {
+            if (node.tags().get_value_by_key("name")) place_count++;
+        }
+        else if (node.tags().get_value_by_key("addr:housenumber"))
+        {
+            housenumber_count++;
+        }
+        else 
+        {
+            count_misc(node.tags());
+        }
+    }
+
+    // Counts the degrees of the road nodes in way(). The junction
+    // statistics need a second pass over the ways with
+    // classify_junctions() (see JunctionHandler).
+    void enable_junctions(NodeRefCounter *counter)
+    {
+        node_refs = counter;
+    }
+
+    // Nodes of roads where three or more road segments meet are
+    // intersections (each counted once per road); end nodes of roads
+    // where no other segment meets are dead ends.
+    void classify_junctions(const osmium::Way& way)
+    {
+        const char *hwy = way.tags().get_value_by_key("highway");
+        if (!hwy) return;
+        int rc = road_class(hwy);
+        if (rc == road_none || way.nodes().empty()) return;
+        sort_node_ids(way);
+        for (size_t i = 0; i < way_node_ids.size(); i++)
+        {
+            if (i > 0 && way_node_ids[i] == way_node_ids[i - 1]) continue;
+            if (node_refs->get(way_node_ids[i]) >= 3) intersections[rc]++;
+        }
+        osmium::object_id_type first = way.nodes().front().ref();
+        osmium::object_id_type last = way.nodes().back().ref();
+        if (dead_end(first)) dead_ends[rc]++;
+        if (last != first && dead_end(last)) dead_ends[rc]++;
+    }
+
+    // replaces the length computation for ways, which by default needs
+    // all node locations
+    void set_length_function(std::function<double(const osmium::Way&)> function)
+    {
+        length_function = function;
+    }
+
+    // the values shown by print(), in the same order (lengths in km),
+    // without the junction statistics
+    static const size_t metric_count = 23;
+
+    // metrics()[0 .. length_metric_count) are lengths, the others counts
+    static const size_t length_metric_count = 9;
+
+    std::vector<double> metrics() const
+    {
+        std::vector<double> values(metric_count);
+        metrics(values.data());
+        return values;
+    }
+
+    // fills values[0 .. metric_count) without allocating, see
+    // UserStatisticsHandler
+    void metrics(double *values) const
+    {
+        const double v[metric_count] = {
+            motorway_trunk_length / 1000,
+            primary_secondary_length / 1000,
+            other_road_length / 1000,
+            residential_road_length / 1000,
+            residential_road_with_name_length / 1000,
+            path_length / 1000,
+            river_length / 1000,
+            railway_length / 1000,
+            powerline_length / 1000,
+            double(building_count),
+            double(housenumber_count),
+            double(place_count),
+            double(landuse_green_count),
+            double(landuse_blue_count),
+            double(landuse_zone_count),
+            double(landuse_agri_count),
+            double(poi_power_count),
+            double(poi_traffic_count),
+            double(poi_public_count),
+            double(poi_hospitality_count),
+            double(poi_shop_count),
+            double(poi_religion_count),
+            double(poi_other_count)
+        };
+        std::copy(v, v + metric_count, values);
+    }
+
+    // the label of metrics()[i] in print()
+    static const char *metric_label(size_t i)
+    {
+        static const char *const labels[] = {
+            "motorways and trunk roads km........",
+            "primary and secondary roads km......",
+            "other connecting roads km...........",
+            "residential roads km................",
+            "residential roads with names km.....",
+            "tracks/paths km.....................",
+            "rivers km...........................",
+            "railways km.........................",
+            "power lines km......................",
+            "buildings...........................",
+            "house numbers.......................",
+            "named places........................",
+            "forest/meadow landcover count.......",
+            "water area landcover count..........",
+            "residential/industrial zone count...",
+            "agricultural landuse count..........",
+            "POIs power..........................",
+            "POIs transport......................",
+            "POIs public.........................",
+            "POIs hospitality....................",
+            "POIs shop/bank......................",
+            "POIs religion.......................",
+            "POIs other.........................."
+        };
+        return labels[i];
+    }
+
+    // the label without the dots, as used in CSV headers
+    static std::string metric_name(size_t i)
+    {
+        std::string name = metric_label(i);
+        return name.substr(0, name.find_last_not_of('.') + 1);
+    }
+
+    // saves or restores all counters (see checkpoint.hpp)
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        archive.field(motorway_trunk_length);
+        archive.field(primary_secondary_length);
+        archive.field(other_road_length);
+        archive.field(residential_road_with_name_length);
+        archive.field(residential_road_length);
+        archive.field(path_length);
+        archive.field(river_length);
+        archive.field(railway_length);
+        archive.field(powerline_length);
+        archive.field(water_area);
+        archive.field(forest_area);
+        archive.field(building_count);
+        archive.field(housenumber_count);
+        archive.field(place_count);
+        archive.field(poi_power_count);
+        archive.field(poi_traffic_count);
+        archive.field(poi_other_count);
+        archive.field(poi_public_count);
+        archive.field(poi_hospitality_count);
+        archive.field(poi_shop_count);
+        archive.field(poi_religion_count);
+        archive.field(landuse_green_count);
+        archive.field(landuse_blue_count);
+        archive.field(landuse_zone_count);
+        archive.field(landuse_agri_count);
+    }
+
+    void print()
+    {
+        bool csv = false;
+        if (csv)
+        {
+            std::cout <<
+                "motorways and trunk roads km,"
+                "primary and secondary roads km,"
+                "other connecting roads km,"
+                "residential roads km,"
+                "residential roads with names km,"
+                "tracks/paths km,"
+                "rivers km,"
+                "railways km,"
+                "power lines km,"
+                "buildings,"
+                "house numbers,"
+                "named places,"
+                "forest/meadow landcover count,"
+                "water area landcover count,"
+                "residential/industrial zone count,"
+                "agricultural landuse count,"
+                "POIs power,"
+                "POIs transport,"
+                "POIs public,"
+                "POIs hospitality,"
+                "POIs shop/bank,"
+                "POIs religion,"
+                "POIs other";
+            if (node_refs)
+            {
+                std::cout << ",road intersections,road dead ends";
+                for (int rc = 0; rc < road_classes; rc++) std::cout << ",dead ends " << road_class_name(rc) << ",intersections " << road_class_name(rc);
+            }
+            std::cout << std::endl;
+
+            std::cout <<
+                (int) (motorway_trunk_length / 1000) << "," <<
+                (int) (primary_secondary_length / 1000) << "," <<
+                (int) (other_road_length / 1000) << "," <<
+                (int) (residential_road_length / 1000) << "," <<
+                (int) (residential_road_with_name_length / 1000) << "," <<
+                (int) (path_length / 1000) << "," <<
+                (int) (river_length / 1000) << "," <<
+                (int) (railway_length / 1000) << "," <<
+                (int) (powerline_length / 1000) << "," <<
+                building_count << "," <<
+                housenumber_count << "," <<
+                place_count << "," <<
+                landuse_green_count << "," <<
+                landuse_blue_count << "," <<
+                landuse_zone_count  << "," <<
+                landuse_agri_count  << "," <<
+                poi_power_count << "," <<
+                poi_traffic_count << "," <<
+                poi_public_count << "," <<
+                poi_hospitality_count << "," <<
+                poi_shop_count << "," <<
+                poi_religion_count << "," <<
+                poi_other_count;
+            if (node_refs)
+            {
+                std::cout << "," << node_refs->count_at_least(3) << "," << node_refs->count_at_least(1) - node_refs->count_at_least(2);
+                for (int rc = 0; rc < road_classes; rc++) std::cout << "," << dead_ends[rc] << "," << intersections[rc];
+            }
+            std::cout << std::endl;
+        }
+        else
+        {
+            std::cout << "motorways and trunk roads km........"  <<  (int) (motorway_trunk_length / 1000)             << std::endl;
+            std::cout << "primary and secondary roads km......"  <<  (int) (primary_secondary_length / 1000)          << std::endl;
+            std::cout << "other connecting roads km..........."  <<  (int) (other_road_length / 1000)                 << std::endl;
+            std::cout << "residential roads km................"  <<  (int) (residential_road_length / 1000)           << std::endl;
+            std::cout << "residential roads with names km....."  <<  (int) (residential_road_with_name_length / 1000) << std::endl;
+            std::cout << "tracks/paths km....................."  <<  (int) (path_length / 1000)                       << std::endl;
+            std::cout << "rivers km..........................."  <<  (int) (river_length / 1000)                      << std::endl;
+            std::cout << "railways km........................."  <<  (int) (railway_length / 1000)                    << std::endl;
+            std::cout << "power lines km......................"  <<  (int) (powerline_length / 1000)                  << std::endl;
+            std::cout << "buildings..........................."  <<  building_count                                   << std::endl;
+            std::cout << "house numbers......................."  <<  housenumber_count                                << std::endl;
+            std::cout << "named places........................"  <<  place_count                                      << std::endl;
+            std::cout << "forest/meadow landcover count......."  <<  landuse_green_count                              << std::endl;
+            std::cout << "water area landcover count.........."  <<  landuse_blue_count                               << std::endl;
+            std::cout << "residential/industrial zone count..."  <<  landuse_zone_count                               << std::endl;
+            std::cout << "agricultural landuse count.........."  <<  landuse_agri_count                               << std::endl;
+            std::cout << "POIs power.........................."  <<  poi_power_count                                  << std::endl;
+            std::cout << "POIs transport......................"  <<  poi_traffic_count                                << std::endl;
+            std::cout << "POIs public........................."  <<  poi_public_count                                 << std::endl;
+            std::cout << "POIs hospitality...................."  <<  poi_hospitality_count                            << std::endl;
+            std::cout << "POIs shop/bank......................"  <<  poi_shop_count                                   << std::endl;
+            std::cout << "POIs religion......................."  <<  poi_religion_count                               << std::endl;
+            std::cout << "POIs other.........................."  <<  poi_other_count                                  << std::endl;
+            if (node_refs)
+            {
+                std::cout << "road intersections.................."  <<  node_refs->count_at_least(3)                    << std::endl;
+                std::cout << "road dead ends......................"  <<  node_refs->count_at_least(1) - node_refs->count_at_least(2) << std::endl;
+                for (int rc = 0; rc < road_classes; rc++)
+                {
+                    std::cout << dotted(std::string("dead ends ") + road_class_name(rc)) << dead_ends[rc] << std::endl;
+                }
+                for (int rc = 0; rc < road_classes; rc++)
+                {
+                    std::cout << dotted(std::string("intersections ") + road_class_name(rc)) << intersections[rc] << std::endl;
+                }
+            }
+        }
+
+    }
+
+
+private:
+
+double waylen(const osmium::Way& way)
+{
+    if (length_function) return length_function(way);
+    return osmium::geom::haversine::distance(way.nodes());
+}
+
+};
+
+/* ================================================== */
+
+// Second pass for the junction statistics, see
+// StatisticsHandler::enable_junctions().
+class JunctionHandler : public osmium::handler::Handler
+{
+
+private:
+    StatisticsHandler& stat_handler;
+
+public:
+
+    explicit JunctionHandler(StatisticsHandler& stat_handler) : stat_handler(stat_handler) {
+    }
+
+    void way(const osmium::Way& way)
+    {
+        stat_handler.classify_junctions(way);
+    }
+
+};
+
+/* ================================================== */
+
+// The type of index used. This must match the include file above
+using index_type = osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location>;
+
+// The location handler always depends on the index type
+using location_handler_type = osmium::handler::NodeLocationsForWays<index_type>;
+
+#endif // STATISTICS_HANDLER_HPP
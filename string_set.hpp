@@ -0,0 +1,169 @@
+#ifndef STRING_SET_HPP
+#define STRING_SET_HPP
+
+/*
+  Set of interned strings. The strings are copied into large arena
+  blocks and indexed by an open-addressing hash table, so looking up a
+  string that is already in the set never allocates. Every string gets
+  a dense id (0, 1, 2, ...) in insertion order.
+*/
+
+/*
+
+Public Domain.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hash.hpp"
+
+class StringSet
+{
+
+private:
+    static const size_t block_size = 1024 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large_blocks;
+    size_t block_used = block_size;
+
+    std::vector<const char*> strings;
+    std::vector<uint32_t> lengths;
+    std::vector<uint64_t> hashes;
+
+    // slot contents are string id + 1, 0 marks an empty slot
+    std::vector<uint32_t> slots;
+
+    const char* store(const char* s, size_t length)
+    {
+        char* p;
+        if (length >= block_size / 16)
+        {
+            // long strings get a block of their own
+            large_blocks.emplace_back(new char[length + 1]);
+            p = large_blocks.back().get();
+        }
+        else
+        {
+            if (length + 1 > block_size - block_used)
+            {
+                blocks.emplace_back(new char[block_size]);
+                block_used = 0;
+            }
+            p = blocks.back().get() + block_used;
+            block_used += length + 1;
+        }
+        memcpy(p, s, length);
+        p[length] = 0;
+        return p;
+    }
+
+    void grow()
+    {
+        std::vector<uint32_t> old;
+        old.swap(slots);
+        slots.assign(old.empty() ? 1024 : old.size() * 2, 0);
+        size_t mask = slots.size() - 1;
+        for (uint32_t slot : old)
+        {
+            if (!slot) continue;
+            size_t i = hashes[slot - 1] & mask;
+            while (slots[i]) i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+public:
+
+    static const uint32_t npos = UINT32_MAX;
+
+    // returns the id of the string, or npos if it is not in the set
+    uint32_t find(const char* s, size_t length) const
+    {
+        if (slots.empty()) return npos;
+        uint64_t h = hash_bytes(s, length);
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask; slots[i]; i = (i + 1) & mask)
+        {
+            uint32_t id = slots[i] - 1;
+            if (hashes[id] == h && lengths[id] == length && !memcmp(strings[id], s, length)) return id;
+        }
+        return npos;
+    }
+
+    uint32_t find(const char* s) const
+    {
+        return find(s, strlen(s));
+    }
+
+    // adds the string if it is not in the set yet and returns its id
+    uint32_t insert(const char* s, size_t length)
+    {
+        if (slots.empty()) grow();
+        uint64_t h = hash_bytes(s, length);
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        for (; slots[i]; i = (i + 1) & mask)
+        {
+            uint32_t id = slots[i] - 1;
+            if (hashes[id] == h && lengths[id] == length && !memcmp(strings[id], s, length)) return id;
+        }
+        // only a new string can need a larger table
+        if ((strings.size() + 1) * 4 > slots.size() * 3)
+        {
+            grow();
+            mask = slots.size() - 1;
+            for (i = h & mask; slots[i]; i = (i + 1) & mask) {}
+        }
+        uint32_t id = strings.size();
+        strings.push_back(store(s, length));
+        lengths.push_back(length);
+        hashes.push_back(h);
+        slots[i] = id + 1;
+        return id;
+    }
+
+    uint32_t insert(const char* s)
+    {
+        return insert(s, strlen(s));
+    }
+
+    const char* get(uint32_t id) const
+    {
+        return strings[id];
+    }
+
+    uint32_t length(uint32_t id) const
+    {
+        return lengths[id];
+    }
+
+    size_t size() const
+    {
+        return strings.size();
+    }
+
+    // saves the strings in id order, or inserts them into an empty set
+    // (see checkpoint.hpp)
+    template <typename TArchive>
+    void checkpoint(TArchive& archive)
+    {
+        uint64_t count = strings.size();
+        archive.field(count);
+        std::string s;
+        for (uint64_t id = 0; id < count; id++)
+        {
+            if (!archive.loading()) s.assign(strings[id], lengths[id]);
+            archive.field(s);
+            if (archive.loading()) insert(s.data(), s.size());
+        }
+    }
+
+};
+
+#endif // STRING_SET_HPP